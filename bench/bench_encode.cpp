@@ -0,0 +1,198 @@
+// Microbenchmarks for the protocol encoders and the packet reader, one binary
+// together with bench_game.cpp, bench_fanout.cpp and bench_timers.cpp. Build
+// it with Google Benchmark and the server's include paths, e.g.
+//   g++ -std=c++17 -O2 -pthread -I. -I<websocketpp> -I<asio> bench/*.cpp
+//       -lbenchmark_main -lbenchmark -o bench_server
+// and compare runs with --benchmark_filter / tools/compare.py from the
+// benchmark repository.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define ASIO_STANDALONE
+
+#include <benchmark/benchmark.h>
+
+#include "../network/encode.hpp"
+#include "../network/frame.hpp"
+#include "../network/reader.hpp"
+
+// a room of n members, every other one moved this tick
+static game::cursor_block make_room(size_t n) {
+    game::cursor_block room;
+    for (size_t i = 0; i < n; i++) {
+        room.add(static_cast<uint16_t>(i + 1), static_cast<uint16_t>(i * 7), static_cast<uint16_t>(i * 13));
+        room.moved[i] = i % 2;
+    }
+    return room;
+}
+
+static void bm_encode_event(benchmark::State &state) {
+    uint8_t buffer[network::event_size];
+    uint16_t id = 1;
+
+    for (auto _: state) {
+        benchmark::DoNotOptimize(network::encode_event(buffer, network::event::entered_room, id++));
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(bm_encode_event);
+
+static void bm_encode_color(benchmark::State &state) {
+    uint8_t buffer[network::color_size];
+
+    for (auto _: state) {
+        benchmark::DoNotOptimize(network::encode_color(buffer, 42, 10, 20, 30));
+        benchmark::ClobberMemory();
+    }
+}
+BENCHMARK(bm_encode_color);
+
+static void bm_encode_nick(benchmark::State &state) {
+    std::vector<uint8_t> buffer;
+    std::string nick(state.range(0), 'n');
+
+    for (auto _: state) {
+        network::encode_nick(buffer, 42, nick);
+        benchmark::DoNotOptimize(buffer.data());
+    }
+}
+BENCHMARK(bm_encode_nick)->Arg(8)->Arg(32);
+
+// a fresh buffer each time, like dispatch_message
+static void bm_encode_message(benchmark::State &state) {
+    std::string nick = "Anonymous";
+    std::string content(state.range(0), 'c');
+
+    for (auto _: state) {
+        std::vector<uint8_t> buffer;
+        network::encode_message(buffer, 42, nick, content);
+        benchmark::DoNotOptimize(buffer.data());
+    }
+    state.SetBytesProcessed(state.iterations() * (content.size() + nick.size() + 6));
+}
+BENCHMARK(bm_encode_message)->Arg(16)->Arg(128)->Arg(512);
+
+static void bm_encode_full_cursor(benchmark::State &state) {
+    std::vector<uint8_t> buffer;
+    std::string nick = "Anonymous";
+
+    for (auto _: state) {
+        network::begin_cursors(buffer);
+        network::encode_full_cursor(buffer, 42, 300, 400, network::cursor_flag::full, 0, 60, 255, nick);
+        network::end_cursors(buffer, 1);
+        benchmark::DoNotOptimize(buffer.data());
+    }
+}
+BENCHMARK(bm_encode_full_cursor);
+
+static void bm_encode_moved(benchmark::State &state) {
+    game::cursor_block room = make_room(state.range(0));
+    std::vector<uint8_t> buffer;
+
+    for (auto _: state) {
+        benchmark::DoNotOptimize(network::encode_moved(buffer, room));
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * room.size());
+}
+BENCHMARK(bm_encode_moved)->RangeMultiplier(10)->Range(1, 10000);
+
+static void bm_encode_positions(benchmark::State &state) {
+    game::cursor_block room = make_room(state.range(0));
+    std::vector<uint8_t> buffer;
+
+    for (auto _: state) {
+        network::encode_positions(buffer, room);
+        benchmark::DoNotOptimize(buffer.data());
+    }
+    state.SetItemsProcessed(state.iterations() * room.size());
+}
+BENCHMARK(bm_encode_positions)->RangeMultiplier(10)->Range(1, 10000);
+
+// the packer alone, straight into a buffer sized for the room
+static void bm_pack_cursors(benchmark::State &state) {
+    game::cursor_block room = make_room(state.range(0));
+    std::vector<uint8_t> buffer(room.size() * network::cursor_size);
+
+    for (auto _: state) {
+        network::pack_cursors(buffer.data(), room.id.data(), room.x.data(), room.y.data(),
+                              network::cursor_flag::partial, room.size());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * room.size());
+}
+BENCHMARK(bm_pack_cursors)->RangeMultiplier(10)->Range(1, 10000);
+
+// the fallback on the same rows, for what the shuffles buy
+static void bm_pack_cursors_scalar(benchmark::State &state) {
+    game::cursor_block room = make_room(state.range(0));
+    std::vector<uint8_t> buffer(room.size() * network::cursor_size);
+
+    for (auto _: state) {
+        network::cursor_packer::scalar(0, room.size(), buffer.data(), room.id.data(), room.x.data(), room.y.data(),
+                                       network::cursor_flag::partial);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * room.size());
+}
+BENCHMARK(bm_pack_cursors_scalar)->RangeMultiplier(10)->Range(1, 10000);
+
+static void bm_encode_notes(benchmark::State &state) {
+    std::vector<game::note> notes;
+    for (int64_t i = 0; i < state.range(0); i++) {
+        notes.push_back({static_cast<uint16_t>(i), static_cast<uint16_t>(i * 3), 60, network::note_flag::down, 100});
+    }
+    std::vector<uint8_t> buffer;
+
+    for (auto _: state) {
+        network::encode_notes(buffer, notes);
+        benchmark::DoNotOptimize(buffer.data());
+    }
+    state.SetItemsProcessed(state.iterations() * notes.size());
+}
+BENCHMARK(bm_encode_notes)->Arg(1)->Arg(16)->Arg(256);
+
+// the encoder plus the frame every member will share
+static void bm_make_frame(benchmark::State &state) {
+    std::vector<uint8_t> buffer(state.range(0), 0xAB);
+
+    for (auto _: state) {
+        benchmark::DoNotOptimize(network::make_frame(buffer.data(), buffer.size()));
+    }
+}
+BENCHMARK(bm_make_frame)->Arg(4)->Arg(512)->Arg(70000);
+
+// a chat packet: [opcode][content\0], what on_chat reads
+static void bm_read_string(benchmark::State &state) {
+    std::string payload(1, static_cast<char>(network::opcode::chat));
+    payload.append(state.range(0), 'c');
+    payload.push_back('\0');
+
+    for (auto _: state) {
+        network::packet_reader reader(payload);
+        uint8_t op;
+        std::string_view content;
+        reader.read_u8(op);
+        benchmark::DoNotOptimize(reader.read_string(content));
+        benchmark::DoNotOptimize(content.data());
+    }
+    state.SetBytesProcessed(state.iterations() * payload.size());
+}
+BENCHMARK(bm_read_string)->Arg(8)->Arg(128)->Arg(512);
+
+// a packet without a terminator has to be scanned to the end before it is refused
+static void bm_read_string_unterminated(benchmark::State &state) {
+    std::string payload(1, static_cast<char>(network::opcode::chat));
+    payload.append(state.range(0), 'c');
+
+    for (auto _: state) {
+        network::packet_reader reader(payload);
+        uint8_t op;
+        std::string_view content;
+        reader.read_u8(op);
+        benchmark::DoNotOptimize(reader.read_string(content));
+    }
+}
+BENCHMARK(bm_read_string_unterminated)->Arg(512);
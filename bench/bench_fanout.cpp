@@ -0,0 +1,110 @@
+// Fan-out of one event to a room, see bench_encode.cpp for the build.
+//
+// Runs game_manager::fan_out, the loop mpp_server::send_dispatch uses, over a
+// synthetic room, with each member's session offered the frame through its
+// outbox the way send_to does. There is no socket: a frame the outbox hands
+// back is written and let go of at once, unless the room holds a full send
+// window in flight for every session.
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define ASIO_STANDALONE
+
+#include <benchmark/benchmark.h>
+
+#include "../game/game.hpp"
+#include "../network/encode.hpp"
+#include "../network/frame.hpp"
+
+struct fanout_room {
+    game::game_manager world;
+    std::vector<std::shared_ptr<network::session>> sessions;
+    // every member is local, it stays empty
+    std::vector<std::vector<uint16_t>> relays;
+    // frames the sockets are still "writing", keeping their outboxes at the window
+    std::vector<network::frame_ptr> in_flight;
+
+    explicit fanout_room(size_t n) {
+        for (size_t i = 1; i <= n; i++) {
+            auto s = std::make_shared<network::session>();
+            s->player_id = static_cast<uint16_t>(i);
+            s->in_game = true;
+            sessions.push_back(s);
+
+            game::player p;
+            p.id = static_cast<uint16_t>(i);
+            p.session = s;
+            world.join_room(world.add_player(std::move(p)), "lobby");
+        }
+    }
+
+    // every socket is behind, a full window stays in flight until the room goes
+    void back_up() {
+        std::vector<uint8_t> payload(network::outbox::send_window);
+        network::frame_ptr window = network::make_frame(payload.data(), payload.size());
+        for (auto &s: sessions) in_flight.push_back(s->out.push(window, network::outbox::reliable));
+    }
+
+    // send_dispatch without the socket, returns the frames that would be written now
+    size_t dispatch(const network::frame_ptr &frame, network::outbox::kind kind) {
+        size_t written = 0;
+
+        world.fan_out(world.rooms.find("lobby"), relays, [](const game::player &) { return true; },
+                      [&](const std::shared_ptr<network::session> &s, uint16_t) {
+            written += s->out.push(frame, kind) != nullptr;
+        });
+
+        return written;
+    }
+
+    game::cursor_block &cursors() {
+        return world.rooms[world.rooms.find("lobby")].cursors;
+    }
+};
+
+static void bm_fanout_event(benchmark::State &state) {
+    fanout_room room(state.range(0));
+    uint8_t buffer[network::event_size];
+
+    for (auto _: state) {
+        size_t size = network::encode_event(buffer, network::event::entered_room, 1);
+        benchmark::DoNotOptimize(room.dispatch(network::make_frame(buffer, size), network::outbox::reliable));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(bm_fanout_event)->RangeMultiplier(10)->Range(1, 10000);
+
+// a room's cursor frame with every member moving
+static void bm_fanout_cursors(benchmark::State &state) {
+    fanout_room room(state.range(0));
+    game::cursor_block &block = room.cursors();
+    std::fill(block.moved.begin(), block.moved.end(), 1);
+    std::vector<uint8_t> buffer;
+
+    for (auto _: state) {
+        network::encode_moved(buffer, block);
+        benchmark::DoNotOptimize(room.dispatch(network::make_frame(buffer.data(), buffer.size()),
+                                               network::outbox::cursors));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(bm_fanout_cursors)->RangeMultiplier(10)->Range(1, 10000);
+
+// every socket is behind, so each cursor frame replaces the one queued last tick
+static void bm_fanout_cursors_backlogged(benchmark::State &state) {
+    fanout_room room(state.range(0));
+    room.back_up();
+    std::vector<uint8_t> buffer;
+    network::encode_positions(buffer, room.cursors());
+
+    for (auto _: state) {
+        benchmark::DoNotOptimize(room.dispatch(network::make_frame(buffer.data(), buffer.size()),
+                                               network::outbox::cursors));
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(bm_fanout_cursors_backlogged)->RangeMultiplier(10)->Range(1, 10000);
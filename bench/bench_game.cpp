@@ -0,0 +1,144 @@
+// Microbenchmarks for game_manager bookkeeping, see bench_encode.cpp for the build.
+
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+#include <unistd.h>
+
+#define ASIO_STANDALONE
+
+#include <benchmark/benchmark.h>
+
+#include "../game/game.hpp"
+
+// fills a room with n players, ids 1..n
+static void fill_room(game::game_manager &world, const std::string &room_id, size_t n) {
+    for (size_t i = 1; i <= n; i++) {
+        game::player p;
+        p.id = static_cast<uint16_t>(i);
+        p.nick = "Anonymous";
+        world.join_room(world.add_player(std::move(p)), room_id);
+    }
+}
+
+// a player arriving in and leaving a room that already has n members
+static void bm_add_player(benchmark::State &state) {
+    game::game_manager world;
+    fill_room(world, "lobby", state.range(0));
+    uint16_t id = static_cast<uint16_t>(state.range(0) + 1);
+
+    for (auto _: state) {
+        game::player p;
+        p.id = id;
+        p.nick = "Anonymous";
+        game::player &added = world.add_player(std::move(p));
+        world.join_room(added, "lobby");
+        benchmark::DoNotOptimize(added.room_slot);
+
+        world.delete_player(id);
+    }
+}
+BENCHMARK(bm_add_player)->RangeMultiplier(10)->Range(1, 10000);
+
+// the row of the first member is refilled from the last one on every leave
+static void bm_change_room(benchmark::State &state) {
+    game::game_manager world;
+    fill_room(world, "lobby", state.range(0));
+    game::player &p = *world.players.find(1);
+
+    for (auto _: state) {
+        world.join_room(p, "other");
+        world.join_room(p, "lobby");
+    }
+}
+BENCHMARK(bm_change_room)->RangeMultiplier(10)->Range(1, 10000);
+
+// in-memory history, a store into the ring
+static void bm_add_message(benchmark::State &state) {
+    game::game_manager world;
+    game::message m(std::string(state.range(0), 'c'), "Anonymous", 226, 1, 0);
+    bool created;
+    game::room &room = world.rooms[world.rooms.intern("lobby", created)];
+
+    for (auto _: state) {
+        world.add_message(room, m);
+    }
+}
+BENCHMARK(bm_add_message)->Arg(16)->Arg(512);
+
+// history backed by a chat log in a scratch directory, the compaction every
+// few hundred messages included
+static void bm_add_message_logged(benchmark::State &state) {
+    char dir[] = "/tmp/bench_chatlog_XXXXXX";
+    if (!mkdtemp(dir)) {
+        state.SkipWithError("no scratch directory for the log");
+        return;
+    }
+
+    {
+        game::game_manager world;
+        world.log_dir = dir;
+        game::message m(std::string(state.range(0), 'c'), "Anonymous", 226, 1, 0);
+        bool created;
+        game::room &room = world.rooms[world.rooms.intern("lobby", created)];
+
+        for (auto _: state) {
+            world.add_message(room, m);
+        }
+
+        world.delete_log("lobby");
+    }
+    rmdir(dir);
+}
+BENCHMARK(bm_add_message_logged)->Arg(16)->Arg(512);
+
+// a message followed by the history frame a joiner gets
+static void bm_add_message_and_frame(benchmark::State &state) {
+    game::game_manager world;
+    game::message m(std::string(state.range(0), 'c'), "Anonymous", 226, 1, 0);
+    bool created;
+    game::room &room = world.rooms[world.rooms.intern("lobby", created)];
+
+    for (auto _: state) {
+        world.add_message(room, m);
+        benchmark::DoNotOptimize(room.messages->frame());
+    }
+}
+BENCHMARK(bm_add_message_and_frame)->Arg(16)->Arg(512);
+
+// a block of n cursors with every other row moved since the last tick
+static game::cursor_block staged_block(size_t n) {
+    game::cursor_block block;
+    game::screen_scale screen(1920, 1080);
+    for (size_t i = 0; i < n; i++) {
+        block.add(static_cast<uint16_t>(i + 1), 0, 0, screen);
+        if (i % 2 == 0) block.stage(i, static_cast<uint16_t>(i % 2000), static_cast<uint16_t>(i % 1100));
+    }
+    return block;
+}
+
+// the per-tick pass over a room, with whatever kernel the CPU picks
+static void bm_normalize(benchmark::State &state) {
+    game::cursor_block block = staged_block(state.range(0));
+
+    for (auto _: state) {
+        game::normalize(block);
+        benchmark::DoNotOptimize(block.x.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(bm_normalize)->RangeMultiplier(10)->Range(10, 10000);
+
+static void bm_normalize_scalar(benchmark::State &state) {
+    game::cursor_block block = staged_block(state.range(0));
+    size_t n = block.size();
+
+    for (auto _: state) {
+        game::axis_normalizer::scalar(0, n, block.raw_x.data(), block.width.data(), block.scale_x.data(), block.moved.data(), block.x.data());
+        game::axis_normalizer::scalar(0, n, block.raw_y.data(), block.height.data(), block.scale_y.data(), block.moved.data(), block.y.data());
+        benchmark::DoNotOptimize(block.x.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(bm_normalize_scalar)->RangeMultiplier(10)->Range(10, 10000);
@@ -0,0 +1,49 @@
+// Microbenchmarks for the timing wheel behind session deadlines, see bench_encode.cpp for the build.
+
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "../utils/timing_wheel.hpp"
+
+typedef utils::timing_wheel<uint32_t> wheel;
+
+// n idle sessions spread over the keepalive window, like the network thread holds them
+static void fill(wheel &w, size_t n, std::vector<wheel::handle> &handles) {
+    for (size_t i = 0; i < n; i++) {
+        handles.push_back(w.schedule(static_cast<uint32_t>(i), std::chrono::milliseconds(i * 30000 / n)));
+    }
+}
+
+// a session connecting and closing while n others wait
+static void bm_schedule_cancel(benchmark::State &state) {
+    wheel w(std::chrono::milliseconds(250));
+    std::vector<wheel::handle> handles;
+    fill(w, state.range(0), handles);
+
+    for (auto _: state) {
+        wheel::handle h = w.schedule(0, std::chrono::seconds(10));
+        benchmark::DoNotOptimize(h);
+        w.cancel(h);
+    }
+}
+BENCHMARK(bm_schedule_cancel)->RangeMultiplier(10)->Range(1, 100000);
+
+// one 250ms step of the clock with n sessions whose deadlines come round every 30s
+static void bm_advance(benchmark::State &state) {
+    auto now = std::chrono::steady_clock::now();
+    wheel w(std::chrono::milliseconds(250), now);
+    std::vector<wheel::handle> handles;
+    fill(w, state.range(0), handles);
+
+    for (auto _: state) {
+        now += std::chrono::milliseconds(250);
+        w.advance(now, [&w](uint32_t value) {
+            w.schedule(value, std::chrono::seconds(30));
+        });
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0) / 120);
+}
+BENCHMARK(bm_advance)->RangeMultiplier(10)->Range(1, 100000);
@@ -0,0 +1,179 @@
+#ifndef CHAT_LOG_HPP
+#define CHAT_LOG_HPP
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "message.hpp"
+
+namespace game {
+
+static_assert(std::is_trivially_copyable<message>::value, "messages are written to the log as raw bytes");
+
+// One file per room: a small header followed by an array of fixed-size message
+// records. New messages are appended in place through the mapping; once the
+// array is full the newest ones are moved back to the front. Reopening the file
+// after a restart gives the history back as-is, nothing is parsed or copied.
+// The descriptor is closed once the file is mapped, a log only holds its mapping.
+class chat_log {
+public:
+    static constexpr uint32_t magic = 0x4D50504C; // "MPPL"
+    static constexpr uint16_t version = 1;
+    static constexpr size_t header_size = 512;
+    static constexpr size_t max_room_id_length = 256;
+
+    struct header {
+        uint32_t magic;
+        uint16_t version;
+        uint16_t room_id_length;
+        uint32_t max_records;
+        uint32_t length;
+        char room_id[max_room_id_length];
+    };
+
+    static_assert(sizeof(header) <= header_size, "chat log header doesn't fit");
+
+    ~chat_log() {
+        if (data) munmap(data, size);
+    }
+
+    message *records() {
+        return reinterpret_cast<message *>(static_cast<char *>(data) + header_size);
+    }
+
+    uint32_t &length() {
+        return get_header()->length;
+    }
+
+    size_t max_records() const {
+        return get_header()->max_records;
+    }
+
+    std::string_view room_id() const {
+        return std::string_view(get_header()->room_id, get_header()->room_id_length);
+    }
+
+    // maps the room's log, creating it if needed and allowed. nullptr if there
+    // is none to reuse or the file can't be used
+    static std::unique_ptr<chat_log> open(const std::string &dir, const std::string &room_id, size_t max_records,
+                                          bool create = true) {
+        if (room_id.size() > max_room_id_length) return nullptr;
+
+        std::string path = dir + "/" + file_name(room_id);
+        int fd = ::open(path.c_str(), create ? O_RDWR | O_CREAT : O_RDWR, 0644);
+        if (fd < 0) return nullptr;
+
+        std::unique_ptr<chat_log> log(new chat_log());
+        log->size = header_size + max_records * sizeof(message);
+
+        // the mapping outlives the descriptor
+        struct stat st;
+        bool fresh = false, mapped = false;
+        if (fstat(fd, &st) == 0) {
+            fresh = st.st_size == 0;
+            if (fresh) {
+                mapped = create && ftruncate(fd, log->size) == 0 && log->map(fd);
+            } else {
+                mapped = static_cast<size_t>(st.st_size) == log->size && log->map(fd);
+            }
+        }
+        ::close(fd);
+        if (!mapped) return nullptr;
+
+        header *h = log->get_header();
+        if (fresh) {
+            h->magic = magic;
+            h->version = version;
+            h->room_id_length = static_cast<uint16_t>(room_id.size());
+            h->max_records = static_cast<uint32_t>(max_records);
+            h->length = 0;
+            std::memcpy(h->room_id, room_id.data(), room_id.size());
+        } else if (!log->valid() || log->room_id() != room_id || h->max_records != max_records) {
+            return nullptr;
+        }
+
+        return log;
+    }
+
+    // unlinks the room's log. A history still mapping it keeps working, but
+    // nothing reopens it
+    static void remove(const std::string &dir, const std::string &room_id) {
+        ::unlink((dir + "/" + file_name(room_id)).c_str());
+    }
+
+    // the room a log file was written for, false when the file isn't a chat log
+    static bool room_id_of(const std::string &path, std::string &room_id) {
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0) return false;
+
+        header h;
+        bool ok = ::pread(fd, &h, sizeof(h), 0) == static_cast<ssize_t>(sizeof(h))
+            && h.magic == magic && h.version == version && h.room_id_length <= max_room_id_length;
+        ::close(fd);
+
+        if (ok) room_id.assign(h.room_id, h.room_id_length);
+        return ok;
+    }
+
+private:
+    chat_log() : data(nullptr), size(0) {}
+
+    void *data;
+    size_t size;
+
+    header *get_header() const {
+        return static_cast<header *>(data);
+    }
+
+    bool map(int fd) {
+        void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (p == MAP_FAILED) return false;
+        data = p;
+        return true;
+    }
+
+    bool valid() const {
+        const header *h = get_header();
+        return h->magic == magic && h->version == version
+            && h->room_id_length <= max_room_id_length
+            && h->length <= h->max_records;
+    }
+
+    // room ids can be anything, so the file is named after their hex encoding
+    static std::string file_name(const std::string &room_id) {
+        static const char digits[] = "0123456789abcdef";
+        std::string name;
+        name.reserve(room_id.size() * 2 + 4);
+
+        for (unsigned char c: room_id) {
+            name.push_back(digits[c >> 4]);
+            name.push_back(digits[c & 0x0F]);
+        }
+
+        // keep it under the usual 255 byte limit, the header has the full id
+        if (name.size() > 200) {
+            name.resize(184);
+            char hash[17];
+            std::snprintf(hash, sizeof(hash), "%016zx", std::hash<std::string>()(room_id));
+            name += hash;
+        }
+
+        return name + ".log";
+    }
+};
+
+}
+
+#endif
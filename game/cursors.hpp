@@ -0,0 +1,104 @@
+#ifndef CURSORS_HPP
+#define CURSORS_HPP
+
+#include <cstdint>
+#include <vector>
+
+namespace game {
+
+// How a client's screen maps onto the 0..65535 cursor space, worked out once
+// on hello or resize. The factors are 16.16 fixed point and round up, so a
+// coordinate at the edge of the screen lands exactly on 65535, and a
+// coordinate clamped to the screen times its factor stays within 32 bits.
+struct screen_scale {
+    uint16_t width = 65535, height = 65535;
+    uint32_t x = 1 << 16, y = 1 << 16;
+
+    screen_scale() = default;
+    screen_scale(uint16_t width, uint16_t height) : width(width), height(height), x(factor(width)), y(factor(height)) {}
+
+    static uint32_t factor(uint16_t extent) {
+        if (extent == 0) return 0;
+        return ((uint32_t(65535) << 16) + extent - 1) / extent;
+    }
+};
+
+// Hot cursor state of one room as parallel arrays, so the tick streams over
+// contiguous memory instead of chasing player objects. Row i belongs to the
+// player with id[i]; rows are swap-removed so a room stays packed. Inputs
+// only stage raw screen coordinates, normalize() turns the moved rows into
+// x and y once per tick.
+struct cursor_block {
+    std::vector<uint16_t> id;
+    std::vector<uint16_t> x;
+    std::vector<uint16_t> y;
+    std::vector<uint8_t> moved;
+
+    // the latest input of a moved row, in its client's screen coordinates
+    std::vector<uint16_t> raw_x, raw_y;
+    // the row's screen_scale, split up for the normalize kernels
+    std::vector<uint16_t> width, height;
+    std::vector<uint32_t> scale_x, scale_y;
+
+    size_t size() const {
+        return id.size();
+    }
+
+    size_t add(uint16_t player_id, uint16_t px, uint16_t py, const screen_scale &screen = screen_scale()) {
+        id.push_back(player_id);
+        x.push_back(px);
+        y.push_back(py);
+        moved.push_back(0);
+
+        raw_x.push_back(0);
+        raw_y.push_back(0);
+        width.push_back(screen.width);
+        height.push_back(screen.height);
+        scale_x.push_back(screen.x);
+        scale_y.push_back(screen.y);
+        return id.size() - 1;
+    }
+
+    void stage(size_t i, uint16_t px, uint16_t py) {
+        raw_x[i] = px;
+        raw_y[i] = py;
+        moved[i] = 1;
+    }
+
+    void set_screen(size_t i, const screen_scale &screen) {
+        width[i] = screen.width;
+        height[i] = screen.height;
+        scale_x[i] = screen.x;
+        scale_y[i] = screen.y;
+    }
+
+    // moves the last row into row i, the caller fixes up that player's slot
+    void remove(size_t i) {
+        size_t last = id.size() - 1;
+        id[i] = id[last];
+        x[i] = x[last];
+        y[i] = y[last];
+        moved[i] = moved[last];
+        raw_x[i] = raw_x[last];
+        raw_y[i] = raw_y[last];
+        width[i] = width[last];
+        height[i] = height[last];
+        scale_x[i] = scale_x[last];
+        scale_y[i] = scale_y[last];
+
+        id.pop_back();
+        x.pop_back();
+        y.pop_back();
+        moved.pop_back();
+        raw_x.pop_back();
+        raw_y.pop_back();
+        width.pop_back();
+        height.pop_back();
+        scale_x.pop_back();
+        scale_y.pop_back();
+    }
+};
+
+}
+
+#endif
@@ -1,13 +1,25 @@
 #ifndef GAME_HPP
 #define GAME_HPP
 
-#include <deque>
-#include <unordered_map>
-#include <unordered_set>
+#include <chrono>
+#include <ctime>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "../utils/utils.hpp"
+#include "../utils/timing_wheel.hpp"
 #include "player.hpp"
+#include "player_table.hpp"
+#include "cursors.hpp"
+#include "normalize.hpp"
 #include "message.hpp"
+#include "history.hpp"
+#include "note.hpp"
 #include "room.hpp"
 
 
@@ -15,57 +27,206 @@ namespace game {
 
 class game_manager {
 public:
-    std::unordered_map<uint16_t, std::shared_ptr<player>> active_players;
-    std::unordered_set<uint16_t> pending_deletions;
-    std::unordered_set<room> rooms;
-    std::unordered_map<std::string, std::deque<Message>> id2messages;
-
-    uint16_t add_player(std::shared_ptr<game::Player> player) {
-        uint16_t id = utils::getUint16();
-        while(active_players.find(id) != active_players.end()) {
-          id = utils::getUint16();
-        }
-        active_players[id] = player;
-        return id;
+    // a log nobody has written to for this long goes once its room isn't live
+    static constexpr std::chrono::hours log_idle_cutoff{24 * 30};
+
+    // tick is how often delete_pending() runs, deletions are that precise
+    explicit game_manager(std::chrono::steady_clock::duration tick = std::chrono::milliseconds(33)) : deletions(tick) {}
+
+    player_table players;
+    // players that left, deleted once the ops queued before they left have run
+    utils::timing_wheel<uint16_t> deletions;
+    room_registry rooms;
+    // where room chat logs are kept, empty keeps history in memory only
+    std::string log_dir;
+
+    player &add_player(player &&p) {
+        return players.insert(std::move(p));
+    }
+
+    // takes the player out of this game without tearing it down, used when it moves to another shard
+    player remove_player(uint16_t id) {
+        leave_room(*players.find(id));
+        return players.take(id);
     }
 
     void delete_player(uint16_t id) {
-        auto it = active_players.find(id);
-        if (it == active_players.end()) return;
+        player *p = players.find(id);
+        if (!p) return;
 
-        auto playerPtr = it->second;
+        leave_room(*p);
+        players.erase(id);
+    }
 
-        if (playerPtr->session) {
-            if (playerPtr->session->player) {
-                playerPtr->session->player.reset();
-            }
-            playerPtr->session.reset();
-         }
 
-        active_players.erase(it);
+    void mark_for_deletion(uint16_t id, std::chrono::steady_clock::duration delay = std::chrono::steady_clock::duration::zero()) {
+        deletions.schedule(id, delay);
     }
 
+    // deletes every player whose time is up, on_delete sees each one first
+    template <typename F>
+    void delete_pending(std::chrono::steady_clock::time_point now, F &&on_delete) {
+        deletions.advance(now, [this, &on_delete](uint16_t id) {
+            player *p = players.find(id);
+            if (!p) return;
 
-    void mark_for_deletion(uint16_t id) {
-        pending_deletions.insert(id);
+            on_delete(*p);
+            delete_player(id);
+        });
     }
 
-    void delete_pending() {
-        for (uint16_t id: pending_deletions) {
-            delete_player(id);
+    // true when the room didn't exist. The player owns a room it finds without
+    // an owner, which may be one that emptied this tick and wasn't reclaimed yet,
+    // unless it's the lobby
+    bool join_room(player &p, const std::string &room_id, uint16_t x = 300, uint16_t y = 400) {
+        leave_room(p);
+
+        bool created;
+        p.room = rooms.intern(room_id, created);
+        room &r = rooms[p.room];
+        if (created && !r.messages) r.messages = reopen_history(room_id);
+        if (r.owner_id == room::no_owner && room_id != lobby) {
+            r.owner_id = p.id;
+            if (!created) r.info_changed = true;
         }
-        pending_deletions.clear();
+        p.joined = r.joins++;
+
+        p.room_slot = static_cast<uint32_t>(r.cursors.add(p.id, x, y, p.screen));
+        r.changed = true;
+        return created;
     }
 
-    void add_message(std::string& room_id, Message newMsg) {
-        std::deque<Message> &messages = id2messages[room_id];
+    void leave_room(player &p) {
+        if (p.room == player::no_room) return;
 
-        if (messages.size() >= 100) {
-            messages.pop_front();
+        // the last row takes this one's place so the block stays packed
+        room &r = rooms[p.room];
+        cursor_block &block = r.cursors;
+        block.remove(p.room_slot);
+        if (p.room_slot < block.size()) {
+            players.find(block.id[p.room_slot])->room_slot = p.room_slot;
         }
-        messages.push_back(newMsg);
+
+        // the crown passes to whoever has been in the room longest
+        if (r.owner_id == p.id) {
+            r.owner_id = earliest_member(r);
+            r.info_changed = true;
+        }
+
+        p.room = player::no_room;
+        p.room_slot = player::no_room;
+        r.changed = true;
     }
-}
+
+    // rows are swap-removed so their order says nothing, the join counter does
+    uint16_t earliest_member(const room &r) {
+        uint16_t earliest = room::no_owner;
+        uint32_t joined = 0;
+        for (uint16_t id: r.cursors.id) {
+            const player *member = players.find(id);
+            if (earliest == room::no_owner || member->joined < joined) {
+                earliest = id;
+                joined = member->joined;
+            }
+        }
+        return earliest;
+    }
+
+    // hands a room's members to whoever sends them a frame: those wanted()
+    // picks whose client is on another process go to relays, by gateway, the
+    // rest to send(session, id) while their session is open
+    template <typename Wanted, typename Send>
+    void fan_out(uint32_t index, std::vector<std::vector<uint16_t>> &relays, Wanted &&wanted, Send &&send) {
+        for (uint16_t id: rooms[index].cursors.id) {
+            player &member = *players.find(id);
+            if (!wanted(member)) continue;
+            if (member.gateway != player::local) {
+                relays[member.gateway].push_back(id);
+                continue;
+            }
+
+            auto s = member.session.lock();
+            if (s) send(s, id);
+        }
+    }
+
+    // null while the player is in no room, e.g. between leaving the game and the tick that deletes it
+    room *room_of(const player &p) {
+        return p.room == player::no_room ? nullptr : &rooms[p.room];
+    }
+
+    // played is when the note reached the server, not when the shard got to it,
+    // so queueing on the way doesn't end up in the replay timing
+    void add_note(room &r, uint16_t owner_id, uint8_t key, uint8_t flag, uint8_t velocity,
+                  std::chrono::steady_clock::time_point played) {
+        note_batch &batch = r.notes;
+
+        if (batch.notes.empty()) {
+            batch.start = played;
+        }
+
+        // notes relayed from another process may have been played before the batch started
+        auto delay = std::chrono::duration_cast<std::chrono::milliseconds>(played - batch.start).count();
+        if (delay < 0) delay = 0;
+        if (delay > 0xFFFF) delay = 0xFFFF;
+
+        batch.notes.push_back({owner_id, static_cast<uint16_t>(delay), key, flag, velocity});
+    }
+
+    void add_message(room &r, const message &newMsg) {
+        if (!r.messages) r.messages = open_history(r.name);
+        r.messages->push(newMsg);
+    }
+
+    // the room's log from an earlier run, or from before its parked history was
+    // evicted; null when there's none, a log is only created by a message
+    std::unique_ptr<history> reopen_history(const std::string &room_id) {
+        if (log_dir.empty()) return nullptr;
+
+        auto log = chat_log::open(log_dir, room_id, history::max_records, false);
+        return log ? std::unique_ptr<history>(new history(std::move(log))) : nullptr;
+    }
+
+    void delete_log(const std::string &room_id) {
+        if (!log_dir.empty()) chat_log::remove(log_dir, room_id);
+    }
+
+    // deletes the logs of rooms hosted here, as mine() says, that aren't live
+    // and haven't been written to for idle; a parked history goes with its log.
+    // Also catches logs from earlier runs whose rooms never came back
+    template <typename Mine>
+    void reap_logs(std::chrono::seconds idle, Mine &&mine) {
+        if (log_dir.empty()) return;
+
+        DIR *dir = opendir(log_dir.c_str());
+        if (!dir) return;
+
+        std::time_t cutoff = std::time(nullptr) - idle.count();
+        std::string room_id;
+        while (dirent *entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.size() <= 4 || name.compare(name.size() - 4, 4, ".log") != 0) continue;
+
+            std::string path = log_dir + "/" + name;
+            struct stat st;
+            if (stat(path.c_str(), &st) != 0 || st.st_mtime >= cutoff) continue;
+            if (!chat_log::room_id_of(path, room_id) || !mine(room_id)) continue;
+            if (rooms.find(room_id) != room_registry::none) continue;
+
+            rooms.unpark(room_id);
+            unlink(path.c_str());
+        }
+
+        closedir(dir);
+    }
+
+    std::unique_ptr<history> open_history(const std::string &room_id) {
+        if (log_dir.empty()) return std::unique_ptr<history>(new history());
+
+        auto log = chat_log::open(log_dir, room_id, history::max_records);
+        return std::unique_ptr<history>(log ? new history(std::move(log)) : new history());
+    }
+};
 
 }
 
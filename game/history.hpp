@@ -0,0 +1,104 @@
+#ifndef HISTORY_HPP
+#define HISTORY_HPP
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+#include "../network/frame.hpp"
+#include "../network/opcodes.hpp"
+#include "chat_log.hpp"
+#include "message.hpp"
+
+namespace game {
+
+// A room's last messages plus the history frame built from them. Without a log
+// they are kept on a ring of the capacity joiners see. With one they are
+// appended to the array mapped from the room's chat_log, and the newest ones are
+// moved back to the front when it fills up, so the file is always in order. The
+// frame is only re-encoded after a push, so every joiner in between gets the
+// same prepared message.
+class history {
+public:
+    static constexpr size_t capacity = 100;
+    static constexpr size_t max_records = 4 * capacity;
+
+    history() : memory(new message[capacity]), memory_next(0), memory_length(0) {}
+
+    explicit history(std::unique_ptr<chat_log> log) : log(std::move(log)), memory_next(0), memory_length(0) {}
+
+    void push(const message &m) {
+        if (!log) {
+            memory[memory_next] = m;
+            memory_next = (memory_next + 1) % capacity;
+            if (memory_length < capacity) memory_length++;
+            cached.reset();
+            return;
+        }
+
+        uint32_t &length = log->length();
+        message *records = log->records();
+        if (length == max_records) {
+            // compact down to the newest capacity - 1, the tail is untouched until length drops
+            std::memcpy(records, records + length - (capacity - 1), (capacity - 1) * sizeof(message));
+            length = capacity - 1;
+        }
+
+        records[length] = m;
+        length++;
+        cached.reset();
+    }
+
+    // oldest first
+    const message &at(size_t i) {
+        if (!log) return memory[(memory_next + capacity - memory_length + i) % capacity];
+        return log->records()[log->length() - size() + i];
+    }
+
+    size_t size() {
+        return log ? std::min<size_t>(log->length(), capacity) : memory_length;
+    }
+
+    // history: [opcode][u8 count] then per message [u16 id][u16 hue][f64 timestamp][nick\0][content\0]
+    network::frame_ptr frame() {
+        if (cached) return cached;
+
+        size_t count = size();
+        std::vector<uint8_t> buffer;
+        buffer.reserve(2 + count * 64);
+        buffer.push_back(network::opcode::history);
+        buffer.push_back(static_cast<uint8_t>(count));
+
+        for (size_t i = 0; i < count; i++) {
+            const message &m = at(i);
+            size_t offset = buffer.size();
+            buffer.resize(offset + 12);
+            std::memcpy(&buffer[offset], &m.owner_id, 2);
+            std::memcpy(&buffer[offset + 2], &m.owner_hue, 2);
+            std::memcpy(&buffer[offset + 4], &m.timestamp, 8);
+
+            auto nick = m.get_nick();
+            buffer.insert(buffer.end(), nick.begin(), nick.end());
+            buffer.push_back(0x00);
+
+            auto content = m.get_content();
+            buffer.insert(buffer.end(), content.begin(), content.end());
+            buffer.push_back(0x00);
+        }
+
+        cached = network::make_frame(buffer.data(), buffer.size());
+        return cached;
+    }
+
+private:
+    std::unique_ptr<chat_log> log;
+    // the ring, memory_next is where the next message goes
+    std::unique_ptr<message[]> memory;
+    size_t memory_next;
+    size_t memory_length;
+    network::frame_ptr cached;
+};
+
+}
+
+#endif
@@ -1,16 +1,46 @@
 #ifndef MESSAGE_HPP
 #define MESSAGE_HPP
 
+#include <algorithm>
 #include <string>
+#include <string_view>
+#include <cstdint>
+#include <cstring>
 
 namespace game {
 
+// Fixed-size so a room's history is one contiguous block with no per-message
+// allocations. Records are written to chat logs as raw bytes, so every byte of
+// one is set, padding and the unused ends of the arrays included.
 struct message {
-    std::string content;
-    std::string owner_nick;
+    static constexpr size_t max_content_length = 512;
+    static constexpr size_t max_nick_length = 32;
+
+    message() {
+        std::memset(static_cast<void *>(this), 0, sizeof(message));
+    }
+
+    message(const std::string &content, const std::string &nick, uint16_t hue, uint16_t id, double timestamp) : message() {
+        owner_hue = hue;
+        owner_id = id;
+        this->timestamp = timestamp;
+        content_length = static_cast<uint16_t>(std::min(content.size(), max_content_length));
+        nick_length = static_cast<uint8_t>(std::min(nick.size(), max_nick_length));
+        std::memcpy(this->content, content.data(), content_length);
+        std::memcpy(owner_nick, nick.data(), nick_length);
+    }
+
+    std::string_view get_content() const { return std::string_view(content, content_length); }
+    std::string_view get_nick() const { return std::string_view(owner_nick, nick_length); }
+
     uint16_t owner_hue;
     uint16_t owner_id;
     double timestamp;
+
+    uint16_t content_length;
+    uint8_t nick_length;
+    char owner_nick[max_nick_length];
+    char content[max_content_length];
 };
 
 }
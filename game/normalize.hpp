@@ -0,0 +1,95 @@
+#ifndef NORMALIZE_HPP
+#define NORMALIZE_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+#include "../utils/cpu.hpp"
+#include "cursors.hpp"
+
+namespace game {
+
+// Moves the staged raw coordinates of a block's moved rows into the cursor
+// space, one axis at a time: out[i] = min(raw[i], limit[i]) * scale[i] >> 16
+// where moved[i] is set, out[i] untouched elsewhere. Run through
+// utils::run_kernels.
+struct axis_normalizer {
+    static void scalar(size_t begin, size_t n, const uint16_t *raw, const uint16_t *limit, const uint32_t *scale,
+                       const uint8_t *moved, uint16_t *out) {
+        for (size_t i = begin; i < n; i++) {
+            if (!moved[i]) continue;
+            out[i] = static_cast<uint16_t>((uint32_t(std::min(raw[i], limit[i])) * scale[i]) >> 16);
+        }
+    }
+
+#ifdef MPP_X86_KERNELS
+
+    // 8 rows a step: clamp in 16 bits, widen, multiply, narrow, blend by moved
+    __attribute__((target("sse4.1")))
+    static size_t sse41(size_t n, const uint16_t *raw, const uint16_t *limit, const uint32_t *scale,
+                        const uint8_t *moved, uint16_t *out) {
+        const __m128i zero = _mm_setzero_si128();
+
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            __m128i r = _mm_min_epu16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(raw + i)),
+                                      _mm_loadu_si128(reinterpret_cast<const __m128i *>(limit + i)));
+
+            __m128i lo = _mm_cvtepu16_epi32(r);
+            __m128i hi = _mm_cvtepu16_epi32(_mm_srli_si128(r, 8));
+            lo = _mm_srli_epi32(_mm_mullo_epi32(lo, _mm_loadu_si128(reinterpret_cast<const __m128i *>(scale + i))), 16);
+            hi = _mm_srli_epi32(_mm_mullo_epi32(hi, _mm_loadu_si128(reinterpret_cast<const __m128i *>(scale + i + 4))), 16);
+            __m128i normalized = _mm_packus_epi32(lo, hi);
+
+            __m128i mask = _mm_cmpgt_epi16(_mm_cvtepu8_epi16(_mm_loadl_epi64(reinterpret_cast<const __m128i *>(moved + i))), zero);
+            __m128i old = _mm_loadu_si128(reinterpret_cast<const __m128i *>(out + i));
+            _mm_storeu_si128(reinterpret_cast<__m128i *>(out + i), _mm_blendv_epi8(old, normalized, mask));
+        }
+
+        return i;
+    }
+
+    // the same 16 rows a step, packus works per 128-bit lane so the halves are put back in order
+    __attribute__((target("avx2")))
+    static size_t avx2(size_t n, const uint16_t *raw, const uint16_t *limit, const uint32_t *scale,
+                       const uint8_t *moved, uint16_t *out) {
+        const __m256i zero = _mm256_setzero_si256();
+
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            __m256i r = _mm256_min_epu16(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(raw + i)),
+                                         _mm256_loadu_si256(reinterpret_cast<const __m256i *>(limit + i)));
+
+            __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(r));
+            __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(r, 1));
+            lo = _mm256_srli_epi32(_mm256_mullo_epi32(lo, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(scale + i))), 16);
+            hi = _mm256_srli_epi32(_mm256_mullo_epi32(hi, _mm256_loadu_si256(reinterpret_cast<const __m256i *>(scale + i + 8))), 16);
+            __m256i normalized = _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), _MM_SHUFFLE(3, 1, 2, 0));
+
+            __m256i mask = _mm256_cmpgt_epi16(_mm256_cvtepu8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i *>(moved + i))), zero);
+            __m256i old = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(out + i));
+            _mm256_storeu_si256(reinterpret_cast<__m256i *>(out + i), _mm256_blendv_epi8(old, normalized, mask));
+        }
+
+        return i;
+    }
+
+#endif
+};
+
+inline void normalize_axis(const uint16_t *raw, const uint16_t *limit, const uint32_t *scale,
+                           const uint8_t *moved, uint16_t *out, size_t n) {
+    utils::run_kernels<axis_normalizer>(n, raw, limit, scale, moved, out);
+}
+
+// once per tick, before anything reads the block's positions
+inline void normalize(cursor_block &block) {
+    size_t n = block.size();
+    normalize_axis(block.raw_x.data(), block.width.data(), block.scale_x.data(), block.moved.data(), block.x.data(), n);
+    normalize_axis(block.raw_y.data(), block.height.data(), block.scale_y.data(), block.moved.data(), block.y.data(), n);
+}
+
+}
+
+#endif
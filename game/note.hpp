@@ -0,0 +1,18 @@
+#ifndef NOTE_HPP
+#define NOTE_HPP
+
+#include <cstdint>
+
+namespace game {
+
+struct note {
+    uint16_t owner_id;
+    uint16_t delay; // ms since the first note of the batch
+    uint8_t key;
+    uint8_t flag;
+    uint8_t velocity;
+};
+
+}
+
+#endif
@@ -4,21 +4,23 @@
 #include <string>
 #include <memory>
 #include <cstdint>
-#include <unordered_set>
+#include <vector>
+
+#include "../network/session.hpp"
+#include "cursors.hpp"
 
 namespace game { // this is gonna be a problem later but I can fix it
 
+// The cold side of a player. Its cursor lives in the room's cursor_block.
 class player {
 public:
-    player() x(300), y(400), id(0),
+    player() : id(0),
+        nick(""), is_bot(false),
+        is_player(false), is_dev(false),
         hue(226), red(0), green(60), blue(255),
-        deletion_reason(0),
-        room_id(""), nick(""), is_bot(false),
-        is_player(false), is_dev(false) {}
+        deletion_reason(0), gateway(local), room(no_room), room_slot(no_room), joined(0) {}
 
-    uint16_t x, y;
     uint16_t id;
-    std::string room_id;
     std::string nick;
     network::session_ptr session;
     bool is_bot, is_player, is_dev;
@@ -28,22 +30,28 @@ public:
 
     uint8_t deletion_reason;
 
-    void updateCursor(uint16_t _x, uint16_t _y) {
-        auto s = session.lock();
-        x = (_x * 65535) / s->screen_width;
-        y = (_y * 65535) / s->screen_height;
-    }
+    // the client's screen, copied into the player's row of every room it joins
+    screen_scale screen;
 
-    bool should_have_in_view(std::shared_ptr<player> p) {
-        return p->room_id == room_id;
-    }
+    // the process whose socket the client is on, when it isn't this one the
+    // session is empty and frames for the player are relayed over the bus
+    static constexpr uint8_t local = 0xFF;
+    uint8_t gateway;
 
-    bool does_have_in_view(std::shared_ptr<player> p) {
-        return view.find(p->id) != view.end();
-    }
-}
+    // index of the room in the shard's room_registry and the player's row in
+    // its cursor_block, both no_room while in no room
+    static constexpr uint32_t no_room = static_cast<uint32_t>(-1);
+    uint32_t room;
+    uint32_t room_slot;
+    // the room's join count when the player joined it
+    uint32_t joined;
+
+    // ids whose full cursor the client has received, when it joined its room
+    // this tick: the ids of the snapshot it was sent. Null once the tick has
+    // caught it up, from then on its client shows what the room's seen holds
+    std::shared_ptr<const std::vector<uint16_t>> view;
+};
 
-typedef std::shared_ptr<player> player_ptr;
 }
 
 #endif
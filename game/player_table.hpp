@@ -0,0 +1,77 @@
+#ifndef PLAYER_TABLE_HPP
+#define PLAYER_TABLE_HPP
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "player.hpp"
+
+namespace game {
+
+// Slot storage for a shard's players. The player id is the handle: it maps to
+// a slot through a flat 64k table, so lookups are one index and no refcounts.
+// References are only valid until the next insert.
+class player_table {
+public:
+    static constexpr uint32_t npos = static_cast<uint32_t>(-1);
+
+    player_table() : slot_of(65536, npos), count(0) {}
+
+    player *find(uint16_t id) {
+        uint32_t slot = slot_of[id];
+        return slot == npos ? nullptr : &slots[slot];
+    }
+
+    player &insert(player &&p) {
+        uint32_t slot;
+        if (free_slots.empty()) {
+            slot = static_cast<uint32_t>(slots.size());
+            slots.emplace_back();
+        } else {
+            slot = free_slots.back();
+            free_slots.pop_back();
+        }
+
+        slot_of[p.id] = slot;
+        slots[slot] = std::move(p);
+        count++;
+        return slots[slot];
+    }
+
+    // moves the player out, e.g. to hand it to another shard
+    player take(uint16_t id) {
+        uint32_t slot = slot_of[id];
+        player p = std::move(slots[slot]);
+        release(id, slot);
+        return p;
+    }
+
+    void erase(uint16_t id) {
+        uint32_t slot = slot_of[id];
+        if (slot == npos) return;
+
+        slots[slot] = player();
+        release(id, slot);
+    }
+
+    size_t size() const {
+        return count;
+    }
+
+private:
+    std::vector<player> slots;
+    std::vector<uint32_t> free_slots;
+    std::vector<uint32_t> slot_of;
+    size_t count;
+
+    void release(uint16_t id, uint32_t slot) {
+        slot_of[id] = npos;
+        free_slots.push_back(slot);
+        count--;
+    }
+};
+
+}
+
+#endif
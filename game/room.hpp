@@ -1,14 +1,209 @@
 #ifndef ROOM_HPP
 #define ROOM_HPP
 
+#include <chrono>
+#include <cstdint>
+#include <iterator>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../network/frame.hpp"
+#include "cursors.hpp"
+#include "history.hpp"
+#include "note.hpp"
+
 namespace game {
 
+// the room everyone enters by default, it never has an owner
+constexpr const char *lobby = "lobby";
+
+struct note_batch {
+    std::chrono::steady_clock::time_point start;
+    std::vector<note> notes;
+};
+
+// every member's full cursor record in one frame, for players joining the room
+struct room_snapshot {
+    network::frame_ptr frame;
+    // whose records the frame holds, shared as the view of every joiner sent it
+    std::shared_ptr<const std::vector<uint16_t>> ids;
+};
+
+namespace room_flag {
+
+constexpr uint8_t chat = 1 << 0;    // members other than the owner may chat
+
+} // room_flag
+
+struct room_settings {
+    uint8_t flags = room_flag::chat;
+    uint8_t red = 0, green = 0, blue = 0;
+};
+
+// Everything a shard keeps about one room, reached by the room's index.
 struct room {
-    std::string nick;
-    uint16_t owner_id;
-}
+    static constexpr uint16_t no_owner = 0;
 
-}
+    std::string name;
+    // whoever created it, then the member who joined earliest; no_owner in the lobby
+    uint16_t owner_id = no_owner;
+    // counts joins, each member keeps its number to rank who joined first
+    uint32_t joins = 0;
+    room_settings settings;
+
+    // hot cursor data of the members, the member count is its size
+    cursor_block cursors;
+    // notes played since the last flush
+    note_batch notes;
+    // built on the first join of a tick and shared by every joiner until the
+    // tick ends, or until a member changes how it looks
+    room_snapshot snapshot;
+    // the members as of the last tick, what every member that was already in
+    // the room then shows; one diff against it catches them all up
+    std::vector<uint16_t> seen;
+    // del records for everything in seen, for members moving out; built on
+    // the first move of a tick
+    network::frame_ptr farewell;
+    // opened on the first message, null until then
+    std::unique_ptr<history> messages;
+
+    // membership changed since the last tick
+    bool changed = false;
+    // owner or settings changed since the last tick
+    bool info_changed = false;
+    bool live = false;
+
+    size_t members() const {
+        return cursors.size();
+    }
+};
+
+// Interns room names to small integers for the shard that hosts them. A name
+// is hashed once, when a player joins; after that the room is its index and
+// members, routing and broadcasts compare integers. Rooms that empty out stay
+// until reclaim(), so the index a dispatch captured stays valid for the tick,
+// and a reclaimed room's history is parked by name until the room is used again.
+class room_registry {
+public:
+    static constexpr uint32_t none = static_cast<uint32_t>(-1);
+    // parked histories kept at most, the longest parked go first. One backed by
+    // a chat log loses nothing, its file is mapped again when the room is
+    static constexpr size_t max_parked = 256;
+
+    uint32_t find(const std::string &name) const {
+        auto it = index_of.find(name);
+        return it == index_of.end() ? none : it->second;
+    }
+
+    // the room's index, created says whether the room is new
+    uint32_t intern(const std::string &name, bool &created) {
+        auto it = index_of.find(name);
+        created = it == index_of.end();
+        if (!created) return it->second;
+
+        uint32_t index;
+        if (free_slots.empty()) {
+            index = static_cast<uint32_t>(slots.size());
+            slots.emplace_back(new room());
+        } else {
+            index = free_slots.back();
+            free_slots.pop_back();
+        }
+
+        room &r = *slots[index];
+        r.name = name;
+        r.live = true;
 
+        auto parked_history = parked.find(name);
+        if (parked_history != parked.end()) {
+            r.messages = std::move(parked_history->second.messages);
+            parked_order.erase(parked_history->second.order);
+            parked.erase(parked_history);
+        }
+
+        index_of.emplace(name, index);
+        live_count++;
+        return index;
+    }
+
+    room &operator[](uint32_t index) {
+        return *slots[index];
+    }
+
+    // every slot, dead ones included; check room::live
+    size_t capacity() const {
+        return slots.size();
+    }
+
+    size_t size() const {
+        return live_count;
+    }
+
+    // keeps a room's history for when the room is created again
+    void park(const std::string &name, std::unique_ptr<history> messages) {
+        unpark(name);
+
+        parked_order.push_back(name);
+        parked.emplace(name, parked_history{std::move(messages), std::prev(parked_order.end())});
+
+        while (parked.size() > max_parked) {
+            parked.erase(parked_order.front());
+            parked_order.pop_front();
+        }
+    }
+
+    // drops a parked history, e.g. once its log is gone
+    void unpark(const std::string &name) {
+        auto it = parked.find(name);
+        if (it == parked.end()) return;
+
+        parked_order.erase(it->second.order);
+        parked.erase(it);
+    }
+
+    size_t parked_count() const {
+        return parked.size();
+    }
+
+    // frees every room that has no members left
+    void reclaim() {
+        for (uint32_t index = 0; index < slots.size(); index++) {
+            room &r = *slots[index];
+            if (r.live && r.members() == 0) release(index);
+        }
+    }
+
+    // keep_history is false for a deleted room, a new one by the same name starts empty
+    void release(uint32_t index, bool keep_history = true) {
+        room &r = *slots[index];
+        if (!r.live) return;
+
+        if (r.messages && keep_history) park(r.name, std::move(r.messages));
+        index_of.erase(r.name);
+
+        r = room();
+        free_slots.push_back(index);
+        live_count--;
+    }
+
+private:
+    struct parked_history {
+        std::unique_ptr<history> messages;
+        std::list<std::string>::iterator order;
+    };
+
+    std::vector<std::unique_ptr<room>> slots;
+    std::vector<uint32_t> free_slots;
+    std::unordered_map<std::string, uint32_t> index_of;
+    std::unordered_map<std::string, parked_history> parked;
+    // parked names, longest parked first
+    std::list<std::string> parked_order;
+    size_t live_count = 0;
+};
+
+}
 
 #endif
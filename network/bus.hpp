@@ -0,0 +1,347 @@
+#ifndef BUS_HPP
+#define BUS_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <cerrno>
+#include <cstdlib>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <websocketpp/common/asio.hpp>
+
+#include "reader.hpp"
+#include "../utils/metrics.hpp"
+
+namespace network {
+
+// what a bus message asks for, every field is little-endian like the client protocol
+namespace bus_op {
+
+// gateway -> owner, a client entered the game in one of the owner's rooms
+// [u16 player id][u8 session type][u8 red][u8 green][u8 blue][u16 screen width][u16 screen height][nick\0][room id\0]
+constexpr uint8_t enter = 0x01;
+// gateway -> owner, a client packet for the player, checked and rate limited already.
+// received is when the gateway read it, in steady_clock nanoseconds, which every
+// process on the machine shares
+// [u16 player id][u8 gateway][u8 muted][u64 received][packet]
+constexpr uint8_t packet = 0x02;
+// gateway -> owner, the client left the game or closed
+// [u16 player id][u8 reason]
+constexpr uint8_t leave = 0x03;
+// owner -> gateway, a frame for some of the gateway's clients
+// [u8 outbox kind][u16 count][u16 player id]*count[frame payload]
+constexpr uint8_t relay = 0x04;
+// new owner -> gateway, the player is now hosted by the sender
+// [u16 player id][u8 owner]
+constexpr uint8_t moved = 0x05;
+// owner -> owner, the player changed to a room the receiver owns
+// [u16 player id][u8 gateway][u8 session type][u8 red][u8 green][u8 blue][u16 hue][u16 x][u16 y]
+// [u16 screen width][u16 screen height][nick\0][room id\0]
+constexpr uint8_t adopt = 0x06;
+// owner -> gateway, close the client, e.g. after a bad packet
+// [u16 player id][u16 close code]
+constexpr uint8_t close = 0x07;
+// owner -> gateway, the player is gone and its id can be handed out again
+// [u16 player id]
+constexpr uint8_t release = 0x08;
+// gateway -> owner, the client resized its screen
+// [u16 player id][u16 screen width][u16 screen height]
+constexpr uint8_t screen = 0x09;
+// gateway -> owner, cursor frames for the client were dropped, send it where everyone is
+// [u16 player id]
+constexpr uint8_t resync = 0x0A;
+
+} // bus_op
+
+// Links the server processes that share the listening port. Every process
+// listens on <dir>/<index>.sock and keeps one outgoing stream to each peer,
+// messages are [u32 length][u8 from][u8 op][body] with length counting from
+// the from byte. Everything runs on the strand it is given, so the handler runs
+// in turn with whatever else shares it; send() can be called from any thread
+// and keeps the order of the calls per peer.
+//
+// Peers are trusted with player state, so the directory must belong to this
+// user with mode 0700, inbound streams are only read from processes of the same
+// user, and a stream that claims to come from a process outside the group is
+// dropped.
+class bus {
+public:
+    typedef websocketpp::lib::asio::io_service io_service;
+    typedef io_service::strand strand_type;
+    typedef websocketpp::lib::asio::local::stream_protocol protocol;
+    typedef websocketpp::lib::asio::error_code error_code;
+    typedef std::function<void(uint8_t from, uint8_t op, packet_reader &reader)> handler_type;
+
+    static constexpr size_t header_size = 4 + 1 + 1;
+    static constexpr size_t max_message = 16 * 1024 * 1024;
+    // per peer, messages for a peer that is down or not keeping up are dropped beyond this
+    static constexpr size_t max_queued = 64 * 1024 * 1024;
+
+    bus(io_service &io, strand_type &strand, const std::string &dir, uint8_t self, uint8_t count) :
+        io(io), strand(strand), dir(dir), self(self), count(count), acceptor(io) {
+        for (uint8_t i = 0; i < count; i++) {
+            peers.emplace_back(new peer(io));
+        }
+    }
+
+    // $XDG_RUNTIME_DIR/mpp-bus, or a directory in /tmp named after the user
+    static std::string default_dir() {
+        const char *runtime = std::getenv("XDG_RUNTIME_DIR");
+        if (runtime && *runtime) return std::string(runtime) + "/mpp-bus";
+        return "/tmp/mpp-bus-" + std::to_string(geteuid());
+    }
+
+    uint8_t processes() const {
+        return count;
+    }
+
+    // binds this process' socket and starts connecting to the others, throws if
+    // the directory isn't private to this user or the socket can't be bound
+    void start(handler_type on_message) {
+        handler = std::move(on_message);
+
+        check_dir();
+        std::string path = path_of(self);
+        unlink(path.c_str());
+
+        acceptor.open(protocol());
+        acceptor.bind(protocol::endpoint(path));
+        acceptor.listen();
+        accept();
+
+        for (uint8_t i = 0; i < count; i++) {
+            if (i != self) connect(i);
+        }
+    }
+
+    // an empty message, the body goes after the header
+    static std::vector<uint8_t> message(uint8_t op, size_t body_size = 0) {
+        std::vector<uint8_t> buffer;
+        buffer.reserve(header_size + body_size);
+        buffer.resize(header_size);
+        buffer[5] = op;
+        return buffer;
+    }
+
+    static void put_u8(std::vector<uint8_t> &buffer, uint8_t value) {
+        buffer.push_back(value);
+    }
+
+    static void put_u16(std::vector<uint8_t> &buffer, uint16_t value) {
+        buffer.push_back(static_cast<uint8_t>(value));
+        buffer.push_back(static_cast<uint8_t>(value >> 8));
+    }
+
+    static void put_u64(std::vector<uint8_t> &buffer, uint64_t value) {
+        for (int i = 0; i < 8; i++) {
+            buffer.push_back(static_cast<uint8_t>(value >> (8 * i)));
+        }
+    }
+
+    static void put_string(std::vector<uint8_t> &buffer, std::string_view value) {
+        buffer.insert(buffer.end(), value.begin(), value.end());
+        buffer.push_back(0x00);
+    }
+
+    static void put_bytes(std::vector<uint8_t> &buffer, const uint8_t *data, size_t size) {
+        buffer.insert(buffer.end(), data, data + size);
+    }
+
+    void send(uint8_t to, std::vector<uint8_t> &&message) {
+        uint32_t length = static_cast<uint32_t>(message.size() - 4);
+        std::memcpy(&message[0], &length, 4);
+        message[4] = self;
+
+        strand.post([this, to, message = std::move(message)]() mutable {
+            enqueue(to, std::move(message));
+        });
+    }
+
+    // on the strand only
+    utils::counter sent, received, dropped;
+
+private:
+    struct peer {
+        explicit peer(io_service &io) : socket(io), retry(io), connected(false), writing(false), queued_bytes(0) {}
+
+        protocol::socket socket;
+        websocketpp::lib::asio::steady_timer retry;
+        bool connected, writing;
+        std::deque<std::vector<uint8_t>> queue;
+        std::vector<std::vector<uint8_t>> in_flight;
+        size_t queued_bytes;
+    };
+
+    struct inbound {
+        explicit inbound(io_service &io) : socket(io) {}
+
+        protocol::socket socket;
+        uint8_t length[4];
+        std::vector<uint8_t> body;
+    };
+
+    io_service &io;
+    strand_type &strand;
+    std::string dir;
+    uint8_t self, count;
+    protocol::acceptor acceptor;
+    std::vector<std::unique_ptr<peer>> peers;
+    handler_type handler;
+
+    // creates the directory or checks the existing one, which may have been
+    // made by someone else to listen in or speak for a peer
+    void check_dir() {
+        if (mkdir(dir.c_str(), 0700) != 0 && errno != EEXIST) {
+            throw std::runtime_error("can't create bus directory " + dir);
+        }
+
+        struct stat st;
+        if (lstat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+            throw std::runtime_error("bus directory " + dir + " is not a directory");
+        }
+        if (st.st_uid != geteuid() || (st.st_mode & 0777) != 0700) {
+            throw std::runtime_error("bus directory " + dir + " must be owned by this user with mode 0700");
+        }
+    }
+
+    // the other end of an inbound stream runs as this user
+    static bool same_user(protocol::socket &socket) {
+        struct ucred cred;
+        socklen_t length = sizeof(cred);
+        if (getsockopt(socket.native_handle(), SOL_SOCKET, SO_PEERCRED, &cred, &length) != 0) return false;
+        return cred.uid == geteuid();
+    }
+
+    std::string path_of(uint8_t index) const {
+        return dir + "/" + std::to_string(index) + ".sock";
+    }
+
+    void enqueue(uint8_t to, std::vector<uint8_t> &&message) {
+        if (to == self || to >= count) return;
+
+        peer &p = *peers[to];
+        if (p.queued_bytes + message.size() > max_queued) {
+            dropped.add();
+            return;
+        }
+
+        p.queued_bytes += message.size();
+        p.queue.push_back(std::move(message));
+        write(to);
+    }
+
+    // everything queued goes out in one gathered write
+    void write(uint8_t to) {
+        peer &p = *peers[to];
+        if (!p.connected || p.writing || p.queue.empty()) return;
+
+        p.writing = true;
+        std::vector<websocketpp::lib::asio::const_buffer> buffers;
+        while (!p.queue.empty()) {
+            p.in_flight.push_back(std::move(p.queue.front()));
+            p.queue.pop_front();
+            buffers.push_back(websocketpp::lib::asio::buffer(p.in_flight.back()));
+        }
+
+        websocketpp::lib::asio::async_write(p.socket, buffers, strand.wrap([this, to](const error_code &ec, size_t) {
+            peer &p = *peers[to];
+            p.writing = false;
+
+            for (auto &m: p.in_flight) {
+                p.queued_bytes -= m.size();
+            }
+
+            if (ec) {
+                // the peer went away mid-write, what it may have half received is not resent
+                dropped.add(p.in_flight.size());
+                p.in_flight.clear();
+                reconnect(to);
+                return;
+            }
+
+            sent.add(p.in_flight.size());
+            p.in_flight.clear();
+            write(to);
+        }));
+    }
+
+    void connect(uint8_t to) {
+        peers[to]->socket.async_connect(protocol::endpoint(path_of(to)), strand.wrap([this, to](const error_code &ec) {
+            if (ec) {
+                reconnect(to);
+                return;
+            }
+
+            peers[to]->connected = true;
+            write(to);
+        }));
+    }
+
+    // peers start in any order and may restart, so keep trying every second
+    void reconnect(uint8_t to) {
+        peer &p = *peers[to];
+        p.connected = false;
+
+        error_code ignored;
+        p.socket.close(ignored);
+
+        p.retry.expires_at(std::chrono::steady_clock::now() + std::chrono::seconds(1));
+        p.retry.async_wait(strand.wrap([this, to](const error_code &ec) {
+            if (!ec) connect(to);
+        }));
+    }
+
+    void accept() {
+        auto in = std::make_shared<inbound>(io);
+        acceptor.async_accept(in->socket, strand.wrap([this, in](const error_code &ec) {
+            if (!ec && same_user(in->socket)) read_length(in);
+            accept();
+        }));
+    }
+
+    // a stream that breaks is dropped, its peer reconnects
+    void read_length(std::shared_ptr<inbound> in) {
+        websocketpp::lib::asio::async_read(in->socket, websocketpp::lib::asio::buffer(in->length),
+            strand.wrap([this, in](const error_code &ec, size_t) {
+                if (ec) return;
+
+                uint32_t length;
+                std::memcpy(&length, in->length, 4);
+                if (length < 2 || length > max_message) return;
+
+                in->body.resize(length);
+                read_body(in);
+            }));
+    }
+
+    void read_body(std::shared_ptr<inbound> in) {
+        websocketpp::lib::asio::async_read(in->socket, websocketpp::lib::asio::buffer(in->body),
+            strand.wrap([this, in](const error_code &ec, size_t) {
+                if (ec) return;
+
+                uint8_t from = in->body[0];
+                if (from >= count || from == self) return;
+
+                received.add();
+                packet_reader reader(in->body.data() + 2, in->body.size() - 2);
+                handler(from, in->body[1], reader);
+
+                read_length(in);
+            }));
+    }
+};
+
+}
+
+#endif
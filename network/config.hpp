@@ -0,0 +1,32 @@
+#ifndef CONFIG_HPP
+#define CONFIG_HPP
+
+#include <websocketpp/config/asio_no_tls.hpp>
+
+#include "session.hpp"
+
+namespace network {
+
+// The stock asio config, except every connection carries its session as a
+// base class, so a handler that has the connection has the session too.
+struct server_config : public websocketpp::config::asio {
+    typedef websocketpp::config::asio core;
+
+    typedef core::concurrency_type concurrency_type;
+    typedef core::request_type request_type;
+    typedef core::response_type response_type;
+    typedef core::message_type message_type;
+    typedef core::con_msg_manager_type con_msg_manager_type;
+    typedef core::endpoint_msg_manager_type endpoint_msg_manager_type;
+    typedef core::alog_type alog_type;
+    typedef core::elog_type elog_type;
+    typedef core::rng_type rng_type;
+    typedef core::transport_type transport_type;
+    typedef core::endpoint_base endpoint_base;
+
+    typedef session connection_base;
+};
+
+}
+
+#endif
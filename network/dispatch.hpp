@@ -0,0 +1,47 @@
+#ifndef DISPATCH_HPP
+#define DISPATCH_HPP
+
+#include <cstdint>
+
+#include "opcodes.hpp"
+#include "session.hpp"
+
+namespace network {
+
+// what a session must have done before an opcode is accepted
+namespace require {
+
+constexpr uint8_t none = 0;
+constexpr uint8_t hello = 1 << 0;       // sent ping and hello
+constexpr uint8_t in_game = 1 << 1;
+constexpr uint8_t out_of_game = 1 << 2;
+constexpr uint8_t dev = 1 << 3;
+
+} // require
+
+constexpr uint32_t any_length = 0xFFFFFFFF;
+
+// How one opcode is validated and handled. Lengths count the opcode byte,
+// bucket is the flood control bucket it draws from.
+// Routes are constant, so the server turns each one into its own checker at
+// compile time and only the checks an opcode declares end up in its path.
+template <class handler_type>
+struct route {
+    handler_type handler;
+    uint32_t min_length;
+    uint32_t max_length;
+    uint8_t required;
+    uint8_t bucket;
+};
+
+inline bool meets(const session &s, uint8_t required) {
+    if ((required & require::hello) && !(s.received_hello && s.received_ping)) return false;
+    if ((required & require::in_game) && !s.in_game) return false;
+    if ((required & require::out_of_game) && s.in_game) return false;
+    if ((required & require::dev) && s.type != session_type::dev) return false;
+    return true;
+}
+
+}
+
+#endif
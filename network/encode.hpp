@@ -0,0 +1,156 @@
+#ifndef ENCODE_HPP
+#define ENCODE_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include "opcodes.hpp"
+#include "pack.hpp"
+#include "../game/cursors.hpp"
+#include "../game/note.hpp"
+
+namespace network {
+
+// Wire encoders for what the server broadcasts. They only fill buffers, the
+// caller turns the result into a frame, so they can be measured on their own.
+
+// events: [opcode][event][u16 id], the body of entered/left game and room
+constexpr size_t event_size = 1 + 1 + 2;
+
+inline size_t encode_event(uint8_t *buffer, uint8_t event, uint16_t id) {
+    buffer[0] = opcode::events;
+    buffer[1] = event;
+    std::memcpy(&buffer[2], &id, 2);
+    return event_size;
+}
+
+// [opcode][event][u16 id][r][g][b]
+constexpr size_t color_size = event_size + 3;
+
+inline size_t encode_color(uint8_t *buffer, uint16_t id, uint8_t red, uint8_t green, uint8_t blue) {
+    encode_event(buffer, event::updated_color, id);
+    buffer[4] = red;
+    buffer[5] = green;
+    buffer[6] = blue;
+    return color_size;
+}
+
+// [opcode][event][u16 owner id][u8 flags][r][g][b], for created_room and updated_room.
+// deleted_room is a plain event with the owner's id
+constexpr size_t room_info_size = event_size + 4;
+
+inline size_t encode_room_info(uint8_t *buffer, uint8_t event, uint16_t owner_id,
+                               uint8_t flags, uint8_t red, uint8_t green, uint8_t blue) {
+    encode_event(buffer, event, owner_id);
+    buffer[4] = flags;
+    buffer[5] = red;
+    buffer[6] = green;
+    buffer[7] = blue;
+    return room_info_size;
+}
+
+// [opcode][event][u16 id][nick\0]
+inline void encode_nick(std::vector<uint8_t> &buffer, uint16_t id, std::string_view nick) {
+    buffer.resize(event_size + nick.length() + 1);
+    encode_event(buffer.data(), event::updated_nick, id);
+    std::memcpy(&buffer[event_size], nick.data(), nick.length());
+    buffer[event_size + nick.length()] = 0x00;
+}
+
+// [opcode][event][u16 id][nick\0][content\0]
+inline void encode_message(std::vector<uint8_t> &buffer, uint16_t id, std::string_view nick, std::string_view content) {
+    buffer.resize(event_size + nick.length() + 1 + content.length() + 1);
+    encode_event(buffer.data(), event::sent_message, id);
+
+    size_t offset = event_size;
+    std::memcpy(&buffer[offset], nick.data(), nick.length());
+    offset += nick.length();
+    buffer[offset++] = 0x00;
+    std::memcpy(&buffer[offset], content.data(), content.length());
+    offset += content.length();
+    buffer[offset] = 0x00;
+}
+
+// cursors_v2: [opcode][u16 count] then per cursor [u16 id][u16 x][u16 y][u8 flag],
+// full records are followed by [r][g][b][nick\0]
+constexpr size_t cursor_size = 7;
+
+// starts an empty cursors_v2 frame, the count is filled in by end_cursors
+inline void begin_cursors(std::vector<uint8_t> &buffer) {
+    buffer.assign(3, 0);
+    buffer[0] = opcode::cursors_v2;
+}
+
+inline void end_cursors(std::vector<uint8_t> &buffer, uint16_t count) {
+    std::memcpy(&buffer[1], &count, 2);
+}
+
+inline void encode_cursor(std::vector<uint8_t> &buffer, uint16_t id, uint16_t x, uint16_t y, uint8_t flag) {
+    size_t offset = buffer.size();
+    buffer.resize(offset + cursor_size);
+    std::memcpy(&buffer[offset], &id, 2);
+    std::memcpy(&buffer[offset + 2], &x, 2);
+    std::memcpy(&buffer[offset + 4], &y, 2);
+    buffer[offset + 6] = flag;
+}
+
+inline void encode_full_cursor(std::vector<uint8_t> &buffer, uint16_t id, uint16_t x, uint16_t y, uint8_t flag,
+                               uint8_t red, uint8_t green, uint8_t blue, std::string_view nick) {
+    encode_cursor(buffer, id, x, y, flag);
+    buffer.push_back(red);
+    buffer.push_back(green);
+    buffer.push_back(blue);
+    buffer.insert(buffer.end(), nick.begin(), nick.end());
+    buffer.push_back(0x00);
+}
+
+// the rows of a room that moved since the last tick, returns how many
+inline uint16_t encode_moved(std::vector<uint8_t> &buffer, const game::cursor_block &room) {
+    uint16_t count = 0;
+    for (uint8_t moved: room.moved) {
+        count += moved;
+    }
+
+    begin_cursors(buffer);
+    if (count == 0) return 0;
+
+    buffer.resize(3 + count * cursor_size);
+    pack_moved_cursors(&buffer[3], room.id.data(), room.x.data(), room.y.data(), room.moved.data(),
+                       cursor_flag::partial, room.size());
+
+    end_cursors(buffer, count);
+    return count;
+}
+
+// every row of a room as a partial record
+inline void encode_positions(std::vector<uint8_t> &buffer, const game::cursor_block &room) {
+    begin_cursors(buffer);
+    buffer.resize(3 + room.size() * cursor_size);
+    pack_cursors(&buffer[3], room.id.data(), room.x.data(), room.y.data(), cursor_flag::partial, room.size());
+
+    end_cursors(buffer, static_cast<uint16_t>(room.size()));
+}
+
+// notes: [opcode][u16 count] then per note [u16 id][u16 delay ms][u8 key][u8 flag][u8 velocity]
+inline void encode_notes(std::vector<uint8_t> &buffer, const std::vector<game::note> &notes) {
+    buffer.resize(3 + notes.size() * 7);
+    buffer[0] = opcode::notes;
+    uint16_t count = static_cast<uint16_t>(notes.size());
+    std::memcpy(&buffer[1], &count, 2);
+
+    size_t offset = 3;
+    for (auto &n: notes) {
+        std::memcpy(&buffer[offset], &n.owner_id, 2);
+        std::memcpy(&buffer[offset + 2], &n.delay, 2);
+        buffer[offset + 4] = n.key;
+        buffer[offset + 5] = n.flag;
+        buffer[offset + 6] = n.velocity;
+        offset += 7;
+    }
+}
+
+}
+
+#endif
@@ -0,0 +1,121 @@
+#ifndef FLOOD_HPP
+#define FLOOD_HPP
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <string>
+
+namespace network {
+
+// which token bucket an opcode draws from
+namespace bucket {
+
+constexpr uint8_t none = 0;
+constexpr uint8_t input = 1;
+constexpr uint8_t chat = 2;
+constexpr uint8_t nick = 3;
+constexpr uint8_t color = 4;
+constexpr uint8_t note = 5;
+constexpr uint8_t room = 6;
+constexpr uint8_t join = 7;        // change_room, each new room may cost a log file
+constexpr uint8_t count = 8;
+
+} // bucket
+
+struct bucket_limit {
+    double rate;    // tokens per second
+    double burst;   // bucket size
+};
+
+struct flood_limits {
+    std::array<bucket_limit, bucket::count> buckets;
+    // dropped packets within strike_window before a session is muted, then kicked
+    uint32_t mute_after;
+    uint32_t kick_after;
+    std::chrono::steady_clock::duration strike_window;
+
+    flood_limits() : mute_after(20), kick_after(100), strike_window(std::chrono::seconds(10)) {
+        buckets[bucket::none] = {0, 0};
+        buckets[bucket::input] = {60, 120};
+        buckets[bucket::chat] = {4, 8};
+        buckets[bucket::nick] = {1, 3};
+        buckets[bucket::color] = {2, 5};
+        buckets[bucket::note] = {40, 80};
+        buckets[bucket::room] = {1, 3};
+        buckets[bucket::join] = {1, 5};
+    }
+
+    // overrides from "name=rate/burst,..." e.g. "chat=2/4,note=60/120". False on a bad spec
+    bool parse(const std::string &spec) {
+        static const char *names[bucket::count] = {"", "input", "chat", "nick", "color", "note", "room", "join"};
+
+        size_t start = 0;
+        while (start < spec.size()) {
+            size_t end = spec.find(',', start);
+            if (end == std::string::npos) end = spec.size();
+
+            std::string item = spec.substr(start, end - start);
+            size_t eq = item.find('='), slash = item.find('/');
+            if (eq == std::string::npos || slash == std::string::npos || slash < eq) return false;
+
+            std::string name = item.substr(0, eq);
+            uint8_t b = bucket::none;
+            for (uint8_t i = 1; i < bucket::count; i++) {
+                if (name == names[i]) b = i;
+            }
+            if (b == bucket::none) return false;
+
+            double rate = std::atof(item.substr(eq + 1, slash - eq - 1).c_str());
+            double burst = std::atof(item.substr(slash + 1).c_str());
+            if (rate <= 0 || burst < 1) return false;
+
+            buckets[b] = {rate, burst};
+            start = end + 1;
+        }
+
+        return true;
+    }
+};
+
+class token_bucket {
+public:
+    token_bucket() : tokens(-1) {}
+
+    bool take(std::chrono::steady_clock::time_point now, const bucket_limit &limit) {
+        if (tokens < 0) {
+            tokens = limit.burst;
+        } else {
+            tokens += std::chrono::duration<double>(now - last).count() * limit.rate;
+            if (tokens > limit.burst) tokens = limit.burst;
+        }
+        last = now;
+
+        if (tokens < 1) return false;
+        tokens -= 1;
+        return true;
+    }
+
+private:
+    double tokens;  // negative until the first packet
+    std::chrono::steady_clock::time_point last;
+};
+
+// a session's buckets and how often it ran dry lately
+struct flood_state {
+    std::array<token_bucket, bucket::count> buckets;
+    uint32_t strikes = 0;
+    std::chrono::steady_clock::time_point last_strike;
+
+    // counts a dropped packet, returns the strikes within the window
+    uint32_t strike(std::chrono::steady_clock::time_point now, const flood_limits &limits) {
+        if (now - last_strike > limits.strike_window) strikes = 0;
+        last_strike = now;
+        return ++strikes;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef FRAME_HPP
+#define FRAME_HPP
+
+#include <cstdint>
+#include <memory>
+
+#include <websocketpp/config/asio_no_tls.hpp>
+#include <websocketpp/frame.hpp>
+
+namespace network {
+
+typedef websocketpp::config::asio::message_type message_type;
+typedef message_type::ptr frame_ptr;
+
+// Builds a ready-to-write binary frame. Server frames are never masked, so the
+// header and payload are the same for every connection and websocketpp will
+// write a prepared message as-is; sharing one across a room costs a refcount.
+inline frame_ptr make_frame(const uint8_t *data, size_t size) {
+    frame_ptr msg = std::make_shared<message_type>(
+        message_type::con_msg_man_ptr(), websocketpp::frame::opcode::binary, size);
+
+    msg->set_payload(data, size);
+
+    websocketpp::frame::basic_header header(websocketpp::frame::opcode::binary, size, true, false);
+    websocketpp::frame::extended_header extended(size);
+    msg->set_header(websocketpp::frame::prepare_header(header, extended));
+    msg->set_prepared(true);
+
+    return msg;
+}
+
+}
+
+#endif
@@ -2,6 +2,12 @@
 #define NETWORK_HPP
 
 #include "opcodes.hpp"
-#include "session.hpp
+#include "config.hpp"
+#include "frame.hpp"
+#include "reader.hpp"
+#include "dispatch.hpp"
+#include "flood.hpp"
+#include "session.hpp"
+#include "bus.hpp"
 
 #endif
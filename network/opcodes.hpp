@@ -23,9 +23,10 @@ constexpr uint8_t change_room = 0x11;
 constexpr uint8_t update_room = 0x12;
 constexpr uint8_t delete_room = 0x13;
 constexpr uint8_t note = 0x14;
-constexpr uint8_t debug_ban = 0x17
+constexpr uint8_t debug_ban = 0x17;
 constexpr uint8_t debug_mute = 0x15;
 constexpr uint8_t debug_kick = 0x16;
+constexpr uint8_t debug_metrics = 0x18;
 
 // Server -> Client
 constexpr uint8_t pong = 0x00;
@@ -36,6 +37,7 @@ constexpr uint8_t events = 0xB1;
 constexpr uint8_t history = 0xB2;
 constexpr uint8_t config = 0xB3;
 constexpr uint8_t notes = 0xA7;
+constexpr uint8_t metrics = 0xB4;
 
 } // opcode
 
@@ -0,0 +1,180 @@
+#ifndef OUTBOX_HPP
+#define OUTBOX_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <vector>
+
+#include "frame.hpp"
+
+namespace network {
+
+// Frames a session's socket couldn't take yet. While few bytes are in flight,
+// handed to websocketpp and not written yet, frames go straight through and
+// nothing is kept here. Once it backs up, reliable frames (events, views,
+// history, notes) queue in order, and cursor frames share one slot: a newer
+// one replaces an unsent older one, and the session is resynced with
+// everyone's current position when it catches up. Sessions that stay over
+// budget get dropped. Shards, the network strand and the I/O threads may all
+// touch it, hence the lock.
+//
+// In flight is counted here rather than read from the connection, whose count
+// the I/O threads update under their own lock. Every frame leaves through
+// push(), flush() or sending() as its own shared_ptr to the shared message,
+// and websocketpp lets go of it once the frame is written or the connection
+// is gone; its deleter takes the bytes off again. The connection holds those
+// pointers and is destroyed before its session, so the outbox outlives them.
+class outbox {
+public:
+    enum kind : uint8_t {
+        reliable,
+        cursors
+    };
+
+    // bytes in flight under which frames are written straight away
+    static constexpr size_t send_window = 64 * 1024;
+    static constexpr size_t max_bytes = 1024 * 1024;
+    static constexpr size_t max_frames = 4096;
+    // how long a session may stay over budget, way over it is dropped at once
+    static constexpr std::chrono::seconds grace{3};
+    static constexpr size_t hard_max_bytes = 4 * max_bytes;
+
+    outbox() : bytes(0), in_flight(0), resync(false), listed(false) {}
+
+    // the frame to write now, null when it was queued instead
+    frame_ptr push(const frame_ptr &frame, kind k) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (queue.empty() && !cursor && !resync && in_flight < send_window) return track(frame);
+
+        if (k == cursors) {
+            if (cursor) {
+                bytes -= cursor->get_payload().size();
+                resync = true;
+            }
+            cursor = frame;
+        } else {
+            // anything reliable may change who the client sees, an older
+            // cursor frame can't go out after it
+            drop_cursor();
+            queue.push_back(frame);
+        }
+
+        bytes += frame->get_payload().size();
+        return nullptr;
+    }
+
+    // writes what the socket has room for, oldest first. True when cursor
+    // frames were dropped and the caller should now write a full resync.
+    // write runs after the lock is released, a frame it drops at once takes
+    // its bytes off in flight again
+    template <class write_fn>
+    bool flush(write_fn write) {
+        std::vector<frame_ptr> ready;
+        bool resynced = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            while (!queue.empty() && in_flight < send_window) {
+                bytes -= queue.front()->get_payload().size();
+                ready.push_back(track(queue.front()));
+                queue.pop_front();
+            }
+
+            if (queue.empty() && in_flight < send_window) {
+                if (resync) {
+                    drop_cursor();
+                    resync = false;
+                    resynced = true;
+                } else if (cursor) {
+                    bytes -= cursor->get_payload().size();
+                    ready.push_back(track(cursor));
+                    cursor.reset();
+                }
+            }
+        }
+
+        for (const frame_ptr &frame: ready) write(frame);
+        return resynced;
+    }
+
+    // for a frame written around the queue, e.g. a resync
+    frame_ptr sending(const frame_ptr &frame) {
+        std::lock_guard<std::mutex> lock(mutex);
+        return track(frame);
+    }
+
+    bool over_budget(std::chrono::steady_clock::time_point now) {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (bytes <= max_bytes && queue.size() <= max_frames) {
+            over_since = std::chrono::steady_clock::time_point();
+            return false;
+        }
+
+        if (over_since == std::chrono::steady_clock::time_point()) over_since = now;
+        return bytes > hard_max_bytes || now - over_since > grace;
+    }
+
+    size_t size() {
+        std::lock_guard<std::mutex> lock(mutex);
+        return bytes;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.clear();
+        cursor.reset();
+        bytes = 0;
+        resync = false;
+    }
+
+    // whether some shard is already flushing this outbox every tick
+    bool list() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (listed) return false;
+        listed = true;
+        return true;
+    }
+
+    // stops the flushing once nothing is left, in one step so a frame pushed
+    // meanwhile can't get stranded
+    bool unlist_if_empty() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (!queue.empty() || cursor || resync) return false;
+        listed = false;
+        return true;
+    }
+
+private:
+    std::mutex mutex;
+    std::deque<frame_ptr> queue;
+    frame_ptr cursor;
+    size_t bytes;
+    size_t in_flight;
+    bool resync;
+    bool listed;
+    std::chrono::steady_clock::time_point over_since;
+
+    // called with the lock held
+    frame_ptr track(const frame_ptr &frame) {
+        size_t size = frame->get_payload().size();
+        in_flight += size;
+        return frame_ptr(frame.get(), [this, frame, size](message_type *) {
+            std::lock_guard<std::mutex> lock(mutex);
+            in_flight -= size;
+        });
+    }
+
+    void drop_cursor() {
+        if (!cursor) return;
+        bytes -= cursor->get_payload().size();
+        cursor.reset();
+        resync = true;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef PACK_HPP
+#define PACK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+#include "../utils/cpu.hpp"
+
+namespace network {
+
+#ifdef MPP_X86_KERNELS
+
+// pshufb masks for 8 rows, 56 bytes of records in four 16 byte chunks: per
+// chunk where each output byte comes from in the id, x and y vectors, -128
+// where it doesn't, and where the flag goes
+struct cursor_pack_masks {
+    int8_t id[4][16], x[4][16], y[4][16], flag[4][16];
+};
+
+constexpr cursor_pack_masks make_cursor_pack_masks() {
+    cursor_pack_masks m{};
+    for (int chunk = 0; chunk < 4; chunk++) {
+        for (int b = 0; b < 16; b++) {
+            int j = chunk * 16 + b, row = j / 7, field = j % 7;
+            bool record = j < 56;
+
+            m.id[chunk][b] = record && field < 2 ? static_cast<int8_t>(row * 2 + field) : -128;
+            m.x[chunk][b] = record && (field == 2 || field == 3) ? static_cast<int8_t>(row * 2 + field - 2) : -128;
+            m.y[chunk][b] = record && (field == 4 || field == 5) ? static_cast<int8_t>(row * 2 + field - 4) : -128;
+            m.flag[chunk][b] = record && field == 6 ? -1 : 0;
+        }
+    }
+    return m;
+}
+
+inline constexpr cursor_pack_masks cursor_masks = make_cursor_pack_masks();
+
+#endif
+
+// Packs cursor rows into cursors_v2 records, [u16 id][u16 x][u16 y][u8 flag]
+// little-endian, 7 bytes each, n * 7 bytes to out and nothing past them. Run
+// through utils::run_kernels.
+struct cursor_packer {
+    static void scalar(size_t begin, size_t n, uint8_t *out, const uint16_t *id, const uint16_t *x, const uint16_t *y,
+                       uint8_t flag) {
+        out += begin * 7;
+        for (size_t i = begin; i < n; i++, out += 7) {
+            std::memcpy(out, &id[i], 2);
+            std::memcpy(out + 2, &x[i], 2);
+            std::memcpy(out + 4, &y[i], 2);
+            out[6] = flag;
+        }
+    }
+
+#ifdef MPP_X86_KERNELS
+
+    // 8 rows a step: three shuffles and the flag per chunk, the last chunk holds 8 bytes
+    __attribute__((target("sse4.1")))
+    static size_t sse41(size_t n, uint8_t *out, const uint16_t *id, const uint16_t *x, const uint16_t *y,
+                        uint8_t flag) {
+        const __m128i flags = _mm_set1_epi8(static_cast<char>(flag));
+
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8, out += 56) {
+            __m128i ids = _mm_loadu_si128(reinterpret_cast<const __m128i *>(id + i));
+            __m128i xs = _mm_loadu_si128(reinterpret_cast<const __m128i *>(x + i));
+            __m128i ys = _mm_loadu_si128(reinterpret_cast<const __m128i *>(y + i));
+
+            for (int chunk = 0; chunk < 4; chunk++) {
+                __m128i records = _mm_or_si128(
+                    _mm_or_si128(_mm_shuffle_epi8(ids, _mm_loadu_si128(reinterpret_cast<const __m128i *>(cursor_masks.id[chunk]))),
+                                 _mm_shuffle_epi8(xs, _mm_loadu_si128(reinterpret_cast<const __m128i *>(cursor_masks.x[chunk])))),
+                    _mm_or_si128(_mm_shuffle_epi8(ys, _mm_loadu_si128(reinterpret_cast<const __m128i *>(cursor_masks.y[chunk]))),
+                                 _mm_and_si128(flags, _mm_loadu_si128(reinterpret_cast<const __m128i *>(cursor_masks.flag[chunk])))));
+
+                if (chunk < 3) {
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + chunk * 16), records);
+                } else {
+                    _mm_storel_epi64(reinterpret_cast<__m128i *>(out + 48), records);
+                }
+            }
+        }
+
+        return i;
+    }
+
+    // 16 rows a step: vpshufb stays within 128-bit lanes, so each lane packs its
+    // own 8 rows with the same masks and the lanes are stored 56 bytes apart
+    __attribute__((target("avx2")))
+    static size_t avx2(size_t n, uint8_t *out, const uint16_t *id, const uint16_t *x, const uint16_t *y,
+                       uint8_t flag) {
+        const __m256i flags = _mm256_set1_epi8(static_cast<char>(flag));
+
+        __m256i id_masks[4], x_masks[4], y_masks[4], flag_masks[4];
+        for (int chunk = 0; chunk < 4; chunk++) {
+            id_masks[chunk] = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(cursor_masks.id[chunk])));
+            x_masks[chunk] = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(cursor_masks.x[chunk])));
+            y_masks[chunk] = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(cursor_masks.y[chunk])));
+            flag_masks[chunk] = _mm256_and_si256(flags,
+                _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i *>(cursor_masks.flag[chunk]))));
+        }
+
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16, out += 112) {
+            __m256i ids = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(id + i));
+            __m256i xs = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(x + i));
+            __m256i ys = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(y + i));
+
+            for (int chunk = 0; chunk < 4; chunk++) {
+                __m256i records = _mm256_or_si256(
+                    _mm256_or_si256(_mm256_shuffle_epi8(ids, id_masks[chunk]), _mm256_shuffle_epi8(xs, x_masks[chunk])),
+                    _mm256_or_si256(_mm256_shuffle_epi8(ys, y_masks[chunk]), flag_masks[chunk]));
+
+                __m128i low = _mm256_castsi256_si128(records);
+                __m128i high = _mm256_extracti128_si256(records, 1);
+                if (chunk < 3) {
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + chunk * 16), low);
+                    _mm_storeu_si128(reinterpret_cast<__m128i *>(out + 56 + chunk * 16), high);
+                } else {
+                    _mm_storel_epi64(reinterpret_cast<__m128i *>(out + 48), low);
+                    _mm_storel_epi64(reinterpret_cast<__m128i *>(out + 56 + 48), high);
+                }
+            }
+        }
+
+        return i;
+    }
+
+#endif
+};
+
+inline void pack_cursors(uint8_t *out, const uint16_t *id, const uint16_t *x, const uint16_t *y,
+                         uint8_t flag, size_t n) {
+    utils::run_kernels<cursor_packer>(n, out, id, x, y, flag);
+}
+
+// only the rows with moved set, in order, returns how many. Runs of moved rows
+// long enough to fill a vector go through pack_cursors, shorter ones are
+// written one by one so a scattered room costs no more than the plain loop
+inline size_t pack_moved_cursors(uint8_t *out, const uint16_t *id, const uint16_t *x, const uint16_t *y,
+                                 const uint8_t *moved, uint8_t flag, size_t n) {
+    constexpr size_t min_run = 8;
+
+    size_t packed = 0;
+    size_t i = 0;
+    while (i < n) {
+        if (!moved[i]) {
+            i++;
+            continue;
+        }
+
+        size_t end = i + 1;
+        while (end < n && moved[end]) end++;
+
+        if (end - i >= min_run) {
+            pack_cursors(out + packed * 7, id + i, x + i, y + i, flag, end - i);
+        } else {
+            cursor_packer::scalar(0, end - i, out + packed * 7, id + i, x + i, y + i, flag);
+        }
+        packed += end - i;
+        i = end;
+    }
+
+    return packed;
+}
+
+}
+
+#endif
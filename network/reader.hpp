@@ -0,0 +1,114 @@
+#ifndef READER_HPP
+#define READER_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace network {
+
+enum class read_error : uint8_t {
+    none,
+    too_short,      // the packet ended before the field did
+    no_terminator   // a string ran to the end of the packet without a \0
+};
+
+// Reads fields straight out of the websocket payload: nothing is copied,
+// strings come back as views into the payload and stay valid as long as it
+// does. Numbers are little-endian on the wire. The first failed read sets
+// error() and every read after it fails too, so a handler can read all its
+// fields and check once.
+class packet_reader {
+public:
+    packet_reader(const uint8_t *data, size_t size) : data(data), size(size), offset(0), err(read_error::none) {}
+
+    explicit packet_reader(const std::string &payload)
+        : packet_reader(reinterpret_cast<const uint8_t *>(payload.data()), payload.size()) {}
+
+    bool read_u8(uint8_t &value) {
+        if (!need(1)) return false;
+        value = data[offset++];
+        return true;
+    }
+
+    bool read_u16(uint16_t &value) {
+        if (!need(2)) return false;
+        value = static_cast<uint16_t>(data[offset] | (data[offset + 1] << 8));
+        offset += 2;
+        return true;
+    }
+
+    bool read_u64(uint64_t &value) {
+        if (!need(8)) return false;
+        value = 0;
+        for (int i = 7; i >= 0; i--) {
+            value = (value << 8) | data[offset + i];
+        }
+        offset += 8;
+        return true;
+    }
+
+    // a \0 terminated string, the terminator is consumed but not part of value
+    bool read_string(std::string_view &value) {
+        if (!need(1)) return false;
+
+        const void *end = std::memchr(data + offset, 0, size - offset);
+        if (!end) return fail(read_error::no_terminator);
+
+        size_t length = static_cast<const uint8_t *>(end) - (data + offset);
+        value = std::string_view(reinterpret_cast<const char *>(data + offset), length);
+        offset += length + 1;
+        return true;
+    }
+
+    // the next n bytes as-is
+    bool read_bytes(size_t n, const uint8_t *&value) {
+        if (!need(n)) return false;
+        value = data + offset;
+        offset += n;
+        return true;
+    }
+
+    size_t remaining() const {
+        return size - offset;
+    }
+
+    size_t length() const {
+        return size;
+    }
+
+    // the whole packet, read or not
+    const uint8_t *begin() const {
+        return data;
+    }
+
+    bool ok() const {
+        return err == read_error::none;
+    }
+
+    read_error error() const {
+        return err;
+    }
+
+private:
+    const uint8_t *data;
+    size_t size;
+    size_t offset;
+    read_error err;
+
+    bool need(size_t n) {
+        if (err != read_error::none) return false;
+        if (size - offset < n) return fail(read_error::too_short);
+        return true;
+    }
+
+    bool fail(read_error e) {
+        err = e;
+        return false;
+    }
+};
+
+}
+
+#endif
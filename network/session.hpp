@@ -1,29 +1,65 @@
 #ifndef SESSION_HPP
 #define SESSION_HPP
 
+#include <chrono>
 #include <memory>
+#include <cstdint>
+#include <vector>
 
 #include <websocketpp/common/connection_hdl.hpp>
-#include <../game/player.hpp>
 
-namespace game { class player; }
+#include "outbox.hpp"
+#include "flood.hpp"
+#include "../game/cursors.hpp"
+#include "../utils/timing_wheel.hpp"
 
 namespace network {
 
+// Lives inside its websocketpp connection (see server_config), so it is
+// created and destroyed with it. Shared pointers to a session alias the
+// connection and keep it alive.
 class session {
 public:
-    session(connection_hdl hdl) hdl(hdl), type(0),
+    session() : id(0), type(0),
         received_ping(false), received_hello(false), 
-        screen_width(0), screen_height(0) {}
+        player_id(0), in_game(false), muted(false), metrics_stream(false), remote(false),
+        deadline(utils::timing_wheel<session *>::none), registry_slot(no_slot) {}
 
+    // for logs, unique for the process
+    uint32_t id;
     uint8_t type;
-    connection_hdl hdl;
+    websocketpp::connection_hdl hdl;
     bool received_ping, received_hello;
-    uint16_t screen_width, screen_height;
-    std::shared_ptr<game::player> player;
+    // from the last hello or resize
+    game::screen_scale screen;
+    // handle of the player on whichever shard owns it, valid while in_game
+    uint16_t player_id;
+    bool in_game;
+    // set by a dev, chat from this session is dropped
+    bool muted;
+    // a dev session that asked for the metrics every second
+    bool metrics_stream;
+    // a stand-in for a client connected to another process, whose packets
+    // arrive over the bus. It has no connection behind it
+    bool remote;
+    // on a remote stand-in, when the gateway received the packet being handled
+    std::chrono::steady_clock::time_point received_at;
+    // frames waiting for a slow socket
+    outbox out;
+    flood_state flood;
+
+    // when the client last sent anything, pongs included, and when it last
+    // sent a packet other than a ping; both on the clock of the session deadlines
+    std::chrono::steady_clock::time_point last_seen, last_active;
+    // the session's entry on the network thread's timing wheel, none while it has none
+    utils::timing_wheel<session *>::handle deadline;
+
+    static constexpr size_t no_slot = static_cast<size_t>(-1);
+    // index in the session_registry, no_slot while not registered
+    size_t registry_slot;
 
     bool did_enter_game() {
-        return player != nullptr;
+        return in_game;
     }
 
     bool did_send_hello() {
@@ -33,6 +69,41 @@ public:
 
 typedef std::weak_ptr<session> session_ptr;
 
+// Every open session, packed for iteration. Nothing is looked up here, the
+// message path reaches its session through the connection.
+class session_registry {
+public:
+    void add(session &s) {
+        s.registry_slot = sessions.size();
+        sessions.push_back(&s);
+    }
+
+    void remove(session &s) {
+        if (s.registry_slot == session::no_slot) return;
+
+        session *last = sessions.back();
+        sessions[s.registry_slot] = last;
+        last->registry_slot = s.registry_slot;
+        sessions.pop_back();
+        s.registry_slot = session::no_slot;
+    }
+
+    std::vector<session *>::const_iterator begin() const {
+        return sessions.begin();
+    }
+
+    std::vector<session *>::const_iterator end() const {
+        return sessions.end();
+    }
+
+    size_t size() const {
+        return sessions.size();
+    }
+
+private:
+    std::vector<session *> sessions;
+};
+
 }
 
 #endif
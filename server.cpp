@@ -1,5 +1,25 @@
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cerrno>
 #include <csignal>
+#include <cstdio>
+#include <cstring>
 #include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/stat.h>
 
 #define ASIO_STANDALONE
 
@@ -7,7 +27,13 @@
 #include <websocketpp/server.hpp>
 
 #include "network/network.hpp"
+#include "network/encode.hpp"
 #include "utils/utils.hpp"
+#include "utils/id_allocator.hpp"
+#include "utils/id_set.hpp"
+#include "utils/logger.hpp"
+#include "utils/metrics.hpp"
+#include "utils/timing_wheel.hpp"
 #include "game/game.hpp"
 
 
@@ -15,562 +41,2131 @@ using websocketpp::lib::bind;
 using websocketpp::lib::placeholders::_1;
 using websocketpp::lib::placeholders::_2;
 
-typedef websocketpp::server<websocketpp::config::asio> server;
+typedef websocketpp::server<network::server_config> server;
 typedef websocketpp::connection_hdl connection_hdl;
 typedef server::message_ptr message_ptr;
 
 
 class mpp_server {
 public:
-    mpp_server() {
+    mpp_server(uint16_t tick_rate = 30, uint16_t shard_count = 1, const std::string &log_dir = "",
+               const network::flood_limits &flood_limits = network::flood_limits(),
+               uint8_t process = 0, uint8_t process_count = 1, const std::string &bus_dir = "",
+               uint16_t io_threads = 1) :
+        m_io_threads(io_threads),
+        elog(m_server.get_elog()),
+        m_tick_interval(std::chrono::microseconds(1000000 / tick_rate)),
+        m_process(process), m_process_count(process_count),
+        m_player_ids(std::chrono::seconds(5), first_player_id(process, process_count),
+                     static_cast<uint16_t>(first_player_id(process + 1, process_count) - 1)),
+        m_deadlines(deadline_resolution),
+        m_flood_limits(flood_limits) {
         m_server.init_asio();
+        m_network.reset(new websocketpp::lib::asio::io_service::strand(m_server.get_io_service()));
 
-        m_server.set_open_handler(bind(&mpp_server::on_open,this,::_1));
-        m_server.set_close_handler(bind(&mpp_server::on_close,this,::_1));
-        m_server.set_message_handler(bind(&mpp_server::on_message,this,::_1,::_2));
+        for (uint16_t i = 0; i < shard_count; i++) {
+            m_shards.emplace_back(new shard(i, m_tick_interval));
+            m_shards.back()->relays.resize(process_count);
+        }
+
+        for (size_t id = 0; id < 65536; id++) {
+            m_owners[id].store(process, std::memory_order_relaxed);
+        }
+
+        if (process_count > 1) {
+            m_bus.reset(new network::bus(m_server.get_io_service(), *m_network, bus_dir, process, process_count));
+            m_forwarded.remote = true;
+            m_forwarded.in_game = true;
+        }
+
+        if (!log_dir.empty()) {
+            use_log_dir(log_dir);
+        }
+
+        // websocketpp calls these on whichever I/O thread serves the connection,
+        // the work itself goes to the network strand with the connection held
+        m_server.set_open_handler([this](connection_hdl hdl) {
+            server::connection_ptr con = m_server.get_con_from_hdl(hdl);
+            con->set_message_handler([this](connection_hdl hdl, message_ptr msg) {
+                server::connection_ptr con = m_server.get_con_from_hdl(hdl);
+                m_network->post([this, con, hdl, msg]() { on_message(*con, hdl, msg); });
+            });
+            m_network->post([this, con, hdl]() { on_open(hdl); });
+        });
+        m_server.set_close_handler([this](connection_hdl hdl) {
+            server::connection_ptr con = m_server.get_con_from_hdl(hdl);
+            m_network->post([this, con, hdl]() { on_close(hdl); });
+        });
+        m_server.set_pong_handler([this](connection_hdl hdl, std::string) {
+            server::connection_ptr con = m_server.get_con_from_hdl(hdl);
+            m_network->post([this, con, hdl]() { on_pong(hdl); });
+        });
+        m_server.set_http_handler([this](connection_hdl hdl) {
+            server::connection_ptr con = m_server.get_con_from_hdl(hdl);
+            con->defer_http_response();
+            m_network->post([this, con, hdl]() {
+                on_http(hdl);
+                websocketpp::lib::error_code ec;
+                con->send_http_response(ec);
+            });
+        });
+
+        m_server.clear_access_channels(websocketpp::log::alevel::all);
+        m_log.start();
+    }
+
+    ~mpp_server() {
+        for (auto &sh: m_shards) {
+            sh->io.stop();
+            if (sh->thread.joinable()) sh->thread.join();
+        }
+    }
+
+    void start_loop() {
+        for (auto &sh: m_shards) {
+            sh->tick_timer.reset(new websocketpp::lib::asio::steady_timer(sh->io));
+            sh->next_tick = std::chrono::steady_clock::now();
+            schedule_tick(*sh);
+
+            shard *worker = sh.get();
+            sh->thread = std::thread([worker]() { worker->io.run(); });
+        }
+
+        m_report_timer.reset(new websocketpp::lib::asio::steady_timer(m_server.get_io_service()));
+        schedule_report();
+
+        m_metrics_timer.reset(new websocketpp::lib::asio::steady_timer(m_server.get_io_service()));
+        schedule_metrics_stream();
+
+        m_deadline_timer.reset(new websocketpp::lib::asio::steady_timer(m_server.get_io_service()));
+        schedule_deadlines();
+
+        if (m_bus) {
+            m_relay_timer.reset(new websocketpp::lib::asio::steady_timer(m_server.get_io_service()));
+            schedule_relay_flush();
+        }
+    }
+
+    typedef void (mpp_server::*packet_handler)(network::session &, connection_hdl, network::packet_reader &);
+    typedef network::route<packet_handler> packet_route;
+
+    static constexpr uint32_t max_nick_length = 15;
+    static constexpr uint32_t max_room_id_length = 256;
+    static constexpr uint32_t max_chat_length = 500;
+
+    // a client has this long from connecting to its hello and first ping
+    static constexpr std::chrono::seconds handshake_timeout{10};
+    // a client quiet for ping_interval gets a websocket ping, then has pong_timeout to answer
+    static constexpr std::chrono::seconds ping_interval{30};
+    static constexpr std::chrono::seconds pong_timeout{10};
+    // a player that sends nothing but pings for this long is closed
+    static constexpr std::chrono::minutes idle_timeout{30};
+    static constexpr std::chrono::milliseconds deadline_resolution{250};
+
+    // [op][fields...], see the handlers below for each layout
+    static constexpr packet_route route_of(uint8_t op) {
+        using namespace network;
+
+        switch(op) {
+            case opcode::ping:        return {&mpp_server::on_ping, 1, any_length, require::none, bucket::none};
+            case opcode::hello:       return {&mpp_server::on_hello, 5, 5, require::none, bucket::none};
+            case opcode::hello_bot:   return {&mpp_server::on_hello_bot, 5, 5, require::none, bucket::none};
+            case opcode::hello_debug: return {&mpp_server::on_hello_debug, 6, 5 + 64, require::none, bucket::none};
+            case opcode::enter_game:  return {&mpp_server::on_enter_game, 6, 4 + max_nick_length + 1 + max_room_id_length + 1, require::hello | require::out_of_game, bucket::none};
+            case opcode::leave_game:  return {&mpp_server::on_leave_game, 1, 1, require::in_game, bucket::none};
+            case opcode::resize:      return {&mpp_server::on_resize, 5, 5, require::none, bucket::none};
+            case opcode::input:       return {&mpp_server::on_input, 5, 5, require::in_game, bucket::input};
+            case opcode::nick:        return {&mpp_server::on_nick, 2, 1 + max_nick_length + 1, require::in_game, bucket::nick};
+            case opcode::color:       return {&mpp_server::on_color, 4, 4, require::in_game, bucket::color};
+            case opcode::chat:        return {&mpp_server::on_chat, 2, 1 + max_chat_length + 1, require::in_game, bucket::chat};
+            case opcode::change_room: return {&mpp_server::on_change_room, 2, 1 + max_room_id_length + 1, require::in_game, bucket::join};
+            case opcode::update_room: return {&mpp_server::on_update_room, 5, 5, require::in_game, bucket::room};
+            case opcode::delete_room: return {&mpp_server::on_delete_room, 1, 1, require::in_game, bucket::room};
+            case opcode::note:        return {&mpp_server::on_note, 4, 4, require::in_game, bucket::note};
+            case opcode::debug_ban:   return {&mpp_server::on_debug_ban, 3, 3, require::in_game | require::dev, bucket::none};
+            case opcode::debug_mute:  return {&mpp_server::on_debug_mute, 3, 3, require::in_game | require::dev, bucket::none};
+            case opcode::debug_kick:  return {&mpp_server::on_debug_kick, 3, 3, require::in_game | require::dev, bucket::none};
+            case opcode::debug_metrics: return {&mpp_server::on_debug_metrics, 2, 2, require::dev, bucket::none};
+            default:                  return {nullptr, 0, 0, require::none, bucket::none};
+        }
+    }
+
+    // ops that only act on the session's player, they run on the process hosting it
+    static constexpr bool forwarded(uint8_t op) {
+        using namespace network;
+
+        switch(op) {
+            case opcode::input:
+            case opcode::nick:
+            case opcode::color:
+            case opcode::chat:
+            case opcode::change_room:
+            case opcode::update_room:
+            case opcode::delete_room:
+            case opcode::note:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    // the checks op's route declares, then its handler. Unknown opcodes are dropped
+    template <uint8_t op>
+    void checked_packet(network::session &s, connection_hdl hdl, network::packet_reader &reader) {
+        constexpr packet_route route = route_of(op);
+
+        if constexpr (route.handler == nullptr) {
+            return;
+        } else {
+            if constexpr (route.min_length > 1 || route.max_length != network::any_length) {
+                if (reader.length() < route.min_length || reader.length() > route.max_length) {
+                    m_log.write<utils::log_level::info>(utils::log_event::bad_length, s.id, op, static_cast<uint32_t>(reader.length()));
+                    close_client(hdl, websocketpp::close::status::normal, "");
+                    return;
+                }
+            }
+
+            if constexpr (route.required != network::require::none) {
+                if (!network::meets(s, route.required)) {
+                    m_log.write<utils::log_level::debug>(utils::log_event::not_allowed, s.id, op);
+                    return;
+                }
+            }
+
+            if constexpr (route.bucket != network::bucket::none) {
+                auto now = std::chrono::steady_clock::now();
+                if (!s.flood.buckets[route.bucket].take(now, m_flood_limits.buckets[route.bucket])) {
+                    m_log.write<utils::log_level::debug>(utils::log_event::flood_drop, s.id, op);
+                    on_flood(s, hdl, now);
+                    return;
+                }
+            }
+
+            if constexpr (forwarded(op)) {
+                if (m_owners[s.player_id].load(std::memory_order_relaxed) != m_process) {
+                    forward_packet(s, reader);
+                    return;
+                }
+            }
+
+            (this->*route.handler)(s, hdl, reader);
+        }
+    }
+
+    // the packet was dropped, keep doing it and the session is muted, then kicked
+    void on_flood(network::session &s, connection_hdl hdl, std::chrono::steady_clock::time_point now) {
+        uint32_t strikes = s.flood.strike(now, m_flood_limits);
+
+        if (strikes == m_flood_limits.kick_after) {
+            m_log.write<utils::log_level::warn>(utils::log_event::flood_kick, s.id, 0, strikes);
+            close_client(hdl, websocketpp::close::status::policy_violation, "flooding");
+        } else if (strikes == m_flood_limits.mute_after) {
+            m_log.write<utils::log_level::info>(utils::log_event::flood_mute, s.id, 0, strikes);
+            s.muted = true;
+        }
+    }
+
+    template <size_t... ops>
+    static constexpr std::array<packet_handler, 256> make_packet_table(std::index_sequence<ops...>) {
+        return {{&mpp_server::checked_packet<ops>...}};
+    }
+
+    void process_message(network::session &s, const std::string &payload, connection_hdl hdl) {
+        static constexpr std::array<packet_handler, 256> packet_table = make_packet_table(std::make_index_sequence<256>());
+
+        network::packet_reader reader(payload);
+
+        uint8_t op;
+        if (!reader.read_u8(op)) return;
+
+        m_packets[op].add();
+        m_packet_bytes[op].add(payload.size());
+        if (op != network::opcode::ping) s.last_active = s.last_seen;
+
+        (this->*packet_table[op])(s, hdl, reader);
+    }
+
+    // [op]
+    void on_ping(network::session &s, connection_hdl hdl, network::packet_reader &) {
+        m_log.write<utils::log_level::debug>(utils::log_event::ping, s.id);
+        uint8_t pong = network::opcode::pong;
+        send_client(hdl, &pong, 1);
+
+        s.received_ping = true;
+    }
+
+    // [op][u16 screen width][u16 screen height]
+    void on_hello(network::session &s, connection_hdl hdl, network::packet_reader &reader) {
+        m_log.write<utils::log_level::debug>(utils::log_event::hello, s.id, network::opcode::hello);
+        s.type = network::session_type::player;
+        read_screen(s, hdl, reader);
+        s.received_hello = true;
+    }
+
+    void on_hello_bot(network::session &s, connection_hdl hdl, network::packet_reader &reader) {
+        m_log.write<utils::log_level::debug>(utils::log_event::hello, s.id, network::opcode::hello_bot);
+        s.type = network::session_type::bot;
+        read_screen(s, hdl, reader);
+        s.received_hello = true;
+    }
+
+    // [op][u16 screen width][u16 screen height][password\0]
+    void on_hello_debug(network::session &s, connection_hdl hdl, network::packet_reader &reader) {
+        m_log.write<utils::log_level::debug>(utils::log_event::hello, s.id, network::opcode::hello_debug);
+
+        uint16_t width, height;
+        std::string_view pass;
+        reader.read_u16(width);
+        reader.read_u16(height);
+
+        if(!reader.read_string(pass)) {
+            m_log.write<utils::log_level::info>(utils::log_event::bad_packet, s.id, network::opcode::hello_debug);
+            close_client(hdl, websocketpp::close::status::normal, "");
+            return;
+        }
+
+        if(pass == "plsadmin")
+            s.type = network::session_type::dev;
+        else
+            s.type = network::session_type::player;
+
+        set_screen(s, hdl, width, height);
+        s.received_hello = true;
+    }
+
+    // [op][u16 screen width][u16 screen height]
+    void on_resize(network::session &s, connection_hdl hdl, network::packet_reader &reader) {
+        m_log.write<utils::log_level::debug>(utils::log_event::resize, s.id);
+        if (read_screen(s, hdl, reader) && s.in_game) update_screen(s.player_id, s.screen);
+    }
+
+    bool read_screen(network::session &s, connection_hdl hdl, network::packet_reader &reader) {
+        uint16_t width, height;
+        reader.read_u16(width);
+        reader.read_u16(height);
+        return set_screen(s, hdl, width, height);
+    }
+
+    // the scale factors are worked out here, inputs only store what they got
+    bool set_screen(network::session &s, connection_hdl hdl, uint16_t width, uint16_t height) {
+        if(width == 0 || height == 0) {
+            m_log.write<utils::log_level::info>(utils::log_event::bad_screen, s.id);
+            close_client(hdl, websocketpp::close::status::normal, "");
+            return false;
+        }
+
+        s.screen = game::screen_scale(width, height);
+        return true;
+    }
+
+    // to the player's rows, wherever it is hosted
+    void update_screen(uint16_t id, const game::screen_scale &screen) {
+        uint8_t owner = m_owners[id].load();
+        if (owner != m_process) {
+            std::vector<uint8_t> message = network::bus::message(network::bus_op::screen, 6);
+            network::bus::put_u16(message, id);
+            network::bus::put_u16(message, screen.width);
+            network::bus::put_u16(message, screen.height);
+            m_bus->send(owner, std::move(message));
+            return;
+        }
+
+        post_to_player(id, [screen](shard &sh, game::player &p) {
+            p.screen = screen;
+            game::room *room = sh.world.room_of(p);
+            if (room) room->cursors.set_screen(p.room_slot, screen);
+        });
+    }
+
+    // [op][u8 red][u8 green][u8 blue][nick\0][room id\0], an empty room id means the lobby
+    void on_enter_game(network::session &s, connection_hdl hdl, network::packet_reader &reader) {
+        game::player p;
+        std::string_view nick, room;
+
+        reader.read_u8(p.red);
+        reader.read_u8(p.green);
+        reader.read_u8(p.blue);
+        reader.read_string(nick);
+        reader.read_string(room);
+
+        if(!reader.ok() || nick.size() > max_nick_length) {
+            m_log.write<utils::log_level::info>(utils::log_event::bad_packet, s.id, network::opcode::enter_game);
+            close_client(hdl, websocketpp::close::status::normal, "");
+            return;
+        }
+
+        p.nick = nick;
+        p.screen = s.screen;
+        std::string room_id = room.empty() ? game::lobby : std::string(room);
+
+        // aliases the connection, so the shards keep it alive while they send to it
+        server::connection_ptr con = m_server.get_con_from_hdl(hdl);
+        p.session = std::shared_ptr<network::session>(con, con.get());
+        set_type(p, s.type);
+
+        if (!m_player_ids.allocate(p.id)) {
+            m_log.write<utils::log_level::warn>(utils::log_event::out_of_ids, s.id);
+            close_client(hdl, websocketpp::close::status::try_again_later, "");
+            return;
+        }
+        s.player_id = p.id;
+        s.in_game = true;
+
+        uint8_t data[3];
+        data[0] = network::opcode::entered_game;
+        std::memcpy(&data[1], &p.id, 2);
+
+        send_client(hdl, data, sizeof(data));
+
+        uint8_t owner = owner_of(room_id);
+        m_owners[p.id].store(owner);
+        m_remote_players.erase(p.id);
+
+        if (owner != m_process) {
+            // the room's owner hosts the player, this process only keeps the client
+            m_remote_players[p.id] = p.session;
+
+            std::vector<uint8_t> message = network::bus::message(network::bus_op::enter, 10 + nick.size() + room_id.size() + 2);
+            network::bus::put_u16(message, p.id);
+            network::bus::put_u8(message, s.type);
+            network::bus::put_u8(message, p.red);
+            network::bus::put_u8(message, p.green);
+            network::bus::put_u8(message, p.blue);
+            network::bus::put_u16(message, p.screen.width);
+            network::bus::put_u16(message, p.screen.height);
+            network::bus::put_string(message, p.nick);
+            network::bus::put_string(message, room_id);
+            m_bus->send(owner, std::move(message));
+            return;
+        }
+
+        host_player(std::move(p), room_id, 300, 400, false);
+    }
+
+    static void set_type(game::player &p, uint8_t session_type) {
+        switch(session_type) {
+            case network::session_type::player:
+            p.is_player = true;
+            break;
+
+            case network::session_type::bot:
+            p.is_bot = true;
+            break;
+
+            case network::session_type::dev:
+            p.is_dev = true;
+            break;
+        }
+    }
+
+    static uint8_t type_of(const game::player &p) {
+        if (p.is_bot) return network::session_type::bot;
+        if (p.is_dev) return network::session_type::dev;
+        return network::session_type::player;
+    }
+
+    // puts the player on the shard that owns its room. A player that changed
+    // rooms on another process announces itself as entering the room, not the game
+    void host_player(game::player &&p, const std::string &room_id, uint16_t x, uint16_t y, bool adopted) {
+        uint16_t target = shard_of(room_id);
+        m_routes[p.id] = target;
+
+        shard &sh = *m_shards[target];
+        sh.io.post([this, &sh, p = std::move(p), room_id, x, y, adopted]() mutable {
+            sh.ops++;
+            game::player &added = sh.world.add_player(std::move(p));
+            enter_room(sh, added, room_id, x, y, !adopted);
+        });
+    }
+
+    // [op]
+    void on_leave_game(network::session &s, connection_hdl, network::packet_reader &) {
+        s.in_game = false;
+        remove_player(s.player_id, 0x03);
+    }
+
+    // [op][u16 x][u16 y]
+    void on_input(network::session &s, connection_hdl, network::packet_reader &reader) {
+        uint16_t x, y;
+        reader.read_u16(x);
+        reader.read_u16(y);
+
+        // staged as sent, the tick normalizes every moved row of the room at once
+        stage_input(s.player_id, x, y);
+    }
+
+    // [op][nick\0]
+    void on_nick(network::session &s, connection_hdl hdl, network::packet_reader &reader) {
+        std::string_view nick;
+        if(!reader.read_string(nick)) {
+            m_log.write<utils::log_level::info>(utils::log_event::bad_packet, s.id, network::opcode::nick);
+            close_client(s, hdl);
+            return;
+        }
+
+        post_to_player(s.player_id, [this, nick = std::string(nick)](shard &sh, game::player &p) {
+            p.nick = nick;
+            forget_snapshot(sh, p);
+            dispatch_nick(sh, p.id, p.nick, p.room);
+        });
+    }
+
+    // [op][u8 red][u8 green][u8 blue]
+    void on_color(network::session &s, connection_hdl, network::packet_reader &reader) {
+        uint8_t red, green, blue;
+        reader.read_u8(red);
+        reader.read_u8(green);
+        reader.read_u8(blue);
+
+        post_to_player(s.player_id, [this, red, green, blue](shard &sh, game::player &p) {
+            p.red = red;
+            p.green = green;
+            p.blue = blue;
+            forget_snapshot(sh, p);
+
+            dispatch_color(sh, p.id, p.red, p.green, p.blue, p.room);
+        });
+    }
+
+    // [op][message\0]
+    void on_chat(network::session &s, connection_hdl hdl, network::packet_reader &reader) {
+        std::string_view content;
+        if(!reader.read_string(content)) {
+            m_log.write<utils::log_level::info>(utils::log_event::bad_packet, s.id, network::opcode::chat);
+            close_client(s, hdl);
+            return;
+        }
+
+        if(content.empty()) {
+            m_log.write<utils::log_level::debug>(utils::log_event::empty_message, s.id);
+            return;
+        }
+
+        if(s.muted) return;
+
+        double timestamp = std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count();
+
+        post_to_player(s.player_id, [this, chat_message = std::string(content), timestamp](shard &sh, game::player &p) {
+            game::room *room = sh.world.room_of(p);
+            if (!room) return;
+
+            // a room with chat off only lets its owner talk
+            if (!(room->settings.flags & game::room_flag::chat) && room->owner_id != p.id) return;
+
+            dispatch_message(sh, chat_message, p.id, p.nick, p.room);
+
+            sh.world.add_message(*room, game::message(
+                chat_message,
+                p.nick,
+                p.hue,
+                p.id,
+                timestamp
+            ));
+        });
+    }
+
+    // [op][room id\0]
+    void on_change_room(network::session &s, connection_hdl hdl, network::packet_reader &reader) {
+        std::string_view room_id;
+        if(!reader.read_string(room_id) || room_id.empty()) {
+            m_log.write<utils::log_level::info>(utils::log_event::bad_packet, s.id, network::opcode::change_room);
+            close_client(s, hdl);
+            return;
+        }
+
+        post_to_player(s.player_id, [this, room_id = std::string(room_id)](shard &sh, game::player &p) {
+            change_room(sh, p, room_id);
+        });
+    }
+
+    // [op][u8 flags][u8 red][u8 green][u8 blue], owner only
+    void on_update_room(network::session &s, connection_hdl, network::packet_reader &reader) {
+        game::room_settings settings;
+        reader.read_u8(settings.flags);
+        reader.read_u8(settings.red);
+        reader.read_u8(settings.green);
+        reader.read_u8(settings.blue);
+
+        post_to_player(s.player_id, [settings](shard &sh, game::player &p) {
+            game::room *room = sh.world.room_of(p);
+            if (!room || room->owner_id != p.id) return;
+
+            // members hear about it with the next tick, with any other change of owner or settings
+            room->settings = settings;
+            room->info_changed = true;
+        });
+    }
+
+    // [op], owner only. The lobby has no owner, so it can't be deleted
+    void on_delete_room(network::session &s, connection_hdl, network::packet_reader &) {
+        post_to_player(s.player_id, [this](shard &sh, game::player &p) {
+            game::room *room = sh.world.room_of(p);
+            if (!room || room->owner_id != p.id) return;
+
+            delete_room(sh, p.room);
+        });
+    }
+
+    // [op][u8 key][u8 flag][u8 velocity], buffered until the next tick
+    void on_note(network::session &s, connection_hdl, network::packet_reader &reader) {
+        uint8_t key, flag, velocity;
+        reader.read_u8(key);
+        reader.read_u8(flag);
+        reader.read_u8(velocity);
+
+        if(flag != network::note_flag::up && flag != network::note_flag::down) {
+            m_log.write<utils::log_level::debug>(utils::log_event::bad_packet, s.id, network::opcode::note, flag);
+            return;
+        }
+
+        auto played = s.remote ? s.received_at : std::chrono::steady_clock::now();
+        post_to_player(s.player_id, [key, flag, velocity, played](shard &sh, game::player &p) {
+            game::room *room = sh.world.room_of(p);
+            if (room) sh.world.add_note(*room, p.id, key, flag, velocity, played);
+        });
+    }
+
+    // [op][u16 player id] for all three debug ops
+    void on_debug_ban(network::session &s, connection_hdl, network::packet_reader &reader) {
+        uint16_t id;
+        reader.read_u16(id);
+        m_log.write<utils::log_level::info>(utils::log_event::dev_ban, s.id, 0, id);
+
+        with_session_of(id, [this](network::session &target) {
+            std::string address = address_of(target.hdl);
+            if (!address.empty()) m_banned.insert(address);
+            websocketpp::lib::error_code ec;
+            m_server.close(target.hdl, websocketpp::close::status::policy_violation, "banned", ec);
+        });
+    }
+
+    void on_debug_mute(network::session &s, connection_hdl, network::packet_reader &reader) {
+        uint16_t id;
+        reader.read_u16(id);
+        m_log.write<utils::log_level::info>(utils::log_event::dev_mute, s.id, 0, id);
+
+        with_session_of(id, [](network::session &target) {
+            target.muted = true;
+        });
+    }
+
+    void on_debug_kick(network::session &s, connection_hdl, network::packet_reader &reader) {
+        uint16_t id;
+        reader.read_u16(id);
+        m_log.write<utils::log_level::info>(utils::log_event::dev_kick, s.id, 0, id);
+
+        with_session_of(id, [this](network::session &target) {
+            websocketpp::lib::error_code ec;
+            m_server.close(target.hdl, websocketpp::close::status::policy_violation, "kicked", ec);
+        });
+    }
+
+    // [op][u8 on], 1 streams the metrics to this session every second, 0 stops it
+    void on_debug_metrics(network::session &s, connection_hdl, network::packet_reader &reader) {
+        uint8_t on;
+        reader.read_u8(on);
+        s.metrics_stream = on != 0;
+    }
+
+    // the client left the game or closed, its player goes wherever it is hosted
+    void remove_player(uint16_t id, uint8_t reason) {
+        m_remote_players.erase(id);
+        leave(id, reason);
+    }
+
+    // also runs on shards, when the player moved on while this was queued
+    void leave(uint16_t id, uint8_t reason) {
+        uint8_t owner = m_owners[id].load();
+        if (owner != m_process) {
+            std::vector<uint8_t> message = network::bus::message(network::bus_op::leave, 3);
+            network::bus::put_u16(message, id);
+            network::bus::put_u8(message, reason);
+            m_bus->send(owner, std::move(message));
+            return;
+        }
+
+        shard &sh = *m_shards[m_routes[id].load()];
+        sh.io.post([this, &sh, id, reason]() {
+            game::player *p = sh.world.players.find(id);
+            if (!p) {
+                if (m_routes[id].load() != sh.index || m_owners[id].load() != m_process) leave(id, reason);
+                return;
+            }
+
+            sh.ops++;
+            p->deletion_reason = reason;
+            uint32_t room = p->room;
+            sh.world.leave_room(*p);
+            sh.world.mark_for_deletion(p->id);
+            dispatch_left_game(sh, p->id, room);
+        });
+    }
+
+    // hands a checked packet to the process hosting the session's player
+    void forward_packet(network::session &s, network::packet_reader &reader) {
+        std::vector<uint8_t> message = network::bus::message(network::bus_op::packet, 12 + reader.length());
+        network::bus::put_u16(message, s.player_id);
+        network::bus::put_u8(message, m_process);
+        network::bus::put_u8(message, s.muted);
+        network::bus::put_u64(message, std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+        network::bus::put_bytes(message, reader.begin(), reader.length());
+        m_bus->send(m_owners[s.player_id].load(), std::move(message));
+    }
+
+    // after a bad packet, over the bus when the client is connected to another process
+    void close_client(network::session &s, connection_hdl hdl) {
+        if (!s.remote) {
+            close_client(hdl, websocketpp::close::status::normal, "");
+            return;
+        }
+
+        std::vector<uint8_t> message = network::bus::message(network::bus_op::close, 4);
+        network::bus::put_u16(message, s.player_id);
+        network::bus::put_u16(message, websocketpp::close::status::normal);
+        m_bus->send(m_forwarded_gateway, std::move(message));
+    }
+
+    // sessions belong to the network thread, so the player's shard hands it back
+    // here. A client whose player is hosted on another process is right here already
+    void with_session_of(uint16_t id, std::function<void(network::session &)> op) {
+        auto remote = m_remote_players.find(id);
+        if (remote != m_remote_players.end()) {
+            if (auto s = remote->second.lock()) op(*s);
+            return;
+        }
+
+        if (!m_player_ids.in_use(id) || m_owners[id].load() != m_process) return;
+
+        post_to_player(id, [this, op = std::move(op)](shard &, game::player &p) {
+            auto s = p.session.lock();
+            if (!s) return;
+
+            m_network->post([s, op]() {
+                op(*s);
+            });
+        });
+    }
+
+    // Handlers run queued on the network strand, so the connection may have
+    // closed by the time they get to it; the overloads without an error_code
+    // would throw out of io_service::run(), these drop the frame instead
+    void close_client(connection_hdl hdl, websocketpp::close::status::value code, const std::string &reason) {
+        websocketpp::lib::error_code ec;
+        m_server.close(hdl, code, reason, ec);
+    }
+
+    void send_client(connection_hdl hdl, const void *data, size_t size) {
+        websocketpp::lib::error_code ec;
+        m_server.send(hdl, data, size, websocketpp::frame::opcode::binary, ec);
+    }
+
+    // the remote address without its port
+    std::string address_of(connection_hdl hdl) {
+        websocketpp::lib::error_code ec;
+        server::connection_ptr con = m_server.get_con_from_hdl(hdl, ec);
+        if (ec || !con) return "";
+
+        std::string endpoint = con->get_remote_endpoint();
+        size_t colon = endpoint.rfind(':');
+        return colon == std::string::npos ? endpoint : endpoint.substr(0, colon);
+    }
+
+    void on_open(connection_hdl hdl) {
+        if (!m_banned.empty() && m_banned.count(address_of(hdl))) {
+            m_log.write<utils::log_level::info>(utils::log_event::banned);
+            close_client(hdl, websocketpp::close::status::policy_violation, "banned");
+            return;
+        }
+
+        server::connection_ptr con = m_server.get_con_from_hdl(hdl);
+        network::session &s = *con;
+        s.hdl = hdl;
+        s.id = ++m_next_session_id;
+        m_sessions.add(s);
+
+        s.last_seen = s.last_active = m_deadlines.now();
+        s.deadline = m_deadlines.schedule(&s, handshake_timeout);
+    }
+
+    void on_close(connection_hdl hdl) {
+        network::session &s = *m_server.get_con_from_hdl(hdl);
+        m_deadlines.cancel(s.deadline);
+
+        if (s.registry_slot == network::session::no_slot) {
+            return;
+        }
+
+        if (s.did_enter_game()) {
+            s.in_game = false;
+            remove_player(s.player_id, 0);
+        }
+
+        m_sessions.remove(s);
+    }
+
+
+    void on_message(network::session &s, connection_hdl hdl, message_ptr msg) {
+        // turned away in on_open, e.g. banned
+        if (s.registry_slot == network::session::no_slot) return;
+
+        s.last_seen = m_deadlines.now();
+
+        if(msg->get_opcode() == websocketpp::frame::opcode::binary) {
+            process_message(s, msg->get_payload(), hdl);
+        }
+    }
+
+    void on_pong(connection_hdl hdl) {
+        network::session &s = *m_server.get_con_from_hdl(hdl);
+        s.last_seen = m_deadlines.now();
+    }
+
+    void schedule_deadlines() {
+        m_deadline_timer->expires_at(std::chrono::steady_clock::now() + deadline_resolution);
+        m_deadline_timer->async_wait(m_network->wrap([this](websocketpp::lib::asio::error_code const & ec) {
+            if (ec) return;
+
+            m_deadlines.advance(std::chrono::steady_clock::now(), [this](network::session *s) {
+                on_deadline(*s);
+            });
+            schedule_deadlines();
+        }));
+    }
+
+    // the session's deadline came: close it, ping it, or set the next one
+    void on_deadline(network::session &s) {
+        s.deadline = utils::timing_wheel<network::session *>::none;
+
+        auto now = m_deadlines.now();
+        server::connection_type &con = connection_of(s);
+        websocketpp::lib::error_code ec;
+
+        if (!s.did_send_hello()) {
+            m_log.write<utils::log_level::info>(utils::log_event::handshake_timeout, s.id);
+            con.close(websocketpp::close::status::policy_violation, "handshake timeout", ec);
+            return;
+        }
+
+        if (s.in_game && now - s.last_active >= idle_timeout) {
+            m_log.write<utils::log_level::info>(utils::log_event::idle, s.id);
+            con.close(websocketpp::close::status::going_away, "idle", ec);
+            return;
+        }
+
+        if (now - s.last_seen >= ping_interval + pong_timeout) {
+            m_log.write<utils::log_level::info>(utils::log_event::ping_timeout, s.id);
+            con.close(websocketpp::close::status::going_away, "ping timeout", ec);
+            return;
+        }
+
+        // activity only ever pushes the deadline back, so it is checked here
+        // instead of moving the entry on every packet
+        auto next = s.last_seen + ping_interval;
+        if (now >= next) {
+            con.ping("", ec);
+            next += pong_timeout;
+        }
+        if (s.in_game) next = std::min(next, s.last_active + idle_timeout);
+
+        s.deadline = m_deadlines.schedule(&s, next - now);
+    }
+
+    // a process index read off the bus, sh.relays and the peers are indexed by it
+    bool is_process(uint8_t index) const {
+        return index < m_bus->processes();
+    }
+
+    // messages from the other processes, on the network thread like client packets
+    void on_bus(uint8_t from, uint8_t op, network::packet_reader &reader) {
+        switch(op) {
+            case network::bus_op::enter:   on_bus_enter(from, reader); break;
+            case network::bus_op::packet:  on_bus_packet(reader); break;
+            case network::bus_op::leave:   on_bus_leave(reader); break;
+            case network::bus_op::relay:   on_bus_relay(reader); break;
+            case network::bus_op::moved:   on_bus_moved(reader); break;
+            case network::bus_op::adopt:   on_bus_adopt(reader); break;
+            case network::bus_op::close:   on_bus_close(reader); break;
+            case network::bus_op::release: on_bus_release(reader); break;
+            case network::bus_op::screen:  on_bus_screen(reader); break;
+            case network::bus_op::resync:  on_bus_resync(reader); break;
+        }
+    }
+
+    void on_bus_enter(uint8_t from, network::packet_reader &reader) {
+        game::player p;
+        uint8_t type;
+        uint16_t width, height;
+        std::string_view nick, room_id;
+
+        reader.read_u16(p.id);
+        reader.read_u8(type);
+        reader.read_u8(p.red);
+        reader.read_u8(p.green);
+        reader.read_u8(p.blue);
+        reader.read_u16(width);
+        reader.read_u16(height);
+        reader.read_string(nick);
+        reader.read_string(room_id);
+        if (!reader.ok()) return;
+
+        p.nick = nick;
+        p.screen = game::screen_scale(width, height);
+        p.gateway = from;
+        set_type(p, type);
+
+        m_owners[p.id].store(m_process);
+        host_player(std::move(p), std::string(room_id), 300, 400, false);
+    }
+
+    // runs the packet's handler on a stand-in for the remote session
+    void on_bus_packet(network::packet_reader &reader) {
+        uint16_t id;
+        uint8_t gateway, muted;
+        uint64_t received = 0;
+        reader.read_u16(id);
+        reader.read_u8(gateway);
+        reader.read_u8(muted);
+        reader.read_u64(received);
+
+        const uint8_t *packet;
+        size_t size = reader.remaining();
+        if (!reader.read_bytes(size, packet) || size == 0 || !is_process(gateway)) return;
+
+        // it changed rooms to another process, which hosts it now
+        uint8_t owner = m_owners[id].load();
+        if (owner != m_process) {
+            std::vector<uint8_t> message = network::bus::message(network::bus_op::packet, 12 + size);
+            network::bus::put_u16(message, id);
+            network::bus::put_u8(message, gateway);
+            network::bus::put_u8(message, muted);
+            network::bus::put_u64(message, received);
+            network::bus::put_bytes(message, packet, size);
+            m_bus->send(owner, std::move(message));
+            return;
+        }
+
+        network::packet_reader client(packet, size);
+        uint8_t op;
+        client.read_u8(op);
+        if (!forwarded(op)) return;
+
+        m_forwarded.player_id = id;
+        m_forwarded.muted = muted != 0;
+        m_forwarded.received_at = std::chrono::steady_clock::time_point(std::chrono::nanoseconds(received));
+        m_forwarded_gateway = gateway;
+        (this->*route_of(op).handler)(m_forwarded, connection_hdl(), client);
+    }
+
+    void on_bus_leave(network::packet_reader &reader) {
+        uint16_t id;
+        uint8_t reason;
+        reader.read_u16(id);
+        reader.read_u8(reason);
+        if (!reader.ok()) return;
+
+        leave(id, reason);
+    }
+
+    // one frame for any number of this process' clients
+    void on_bus_relay(network::packet_reader &reader) {
+        uint8_t kind;
+        uint16_t count;
+        const uint8_t *ids, *payload;
+        reader.read_u8(kind);
+        reader.read_u16(count);
+        reader.read_bytes(count * 2, ids);
+        size_t size = reader.remaining();
+        if (!reader.read_bytes(size, payload)) return;
+
+        network::frame_ptr frame = network::make_frame(payload, size);
+        network::outbox::kind k = kind == network::outbox::cursors ? network::outbox::cursors : network::outbox::reliable;
+
+        for (uint16_t i = 0; i < count; i++) {
+            uint16_t id = static_cast<uint16_t>(ids[i * 2] | (ids[i * 2 + 1] << 8));
+            auto it = m_remote_players.find(id);
+            if (it == m_remote_players.end()) continue;
+
+            auto s = it->second.lock();
+            if (s) relay_to(s, frame, k);
+        }
+    }
+
+    void on_bus_moved(network::packet_reader &reader) {
+        uint16_t id;
+        uint8_t owner;
+        reader.read_u16(id);
+        reader.read_u8(owner);
+        if (!reader.ok() || !is_process(owner) || !m_remote_players.count(id)) return;
+
+        m_owners[id].store(owner);
+    }
+
+    // a player that changed into one of this process' rooms
+    void on_bus_adopt(network::packet_reader &reader) {
+        game::player p;
+        uint8_t gateway, type;
+        uint16_t x, y, width, height;
+        std::string_view nick, room_id;
+
+        reader.read_u16(p.id);
+        reader.read_u8(gateway);
+        reader.read_u8(type);
+        reader.read_u8(p.red);
+        reader.read_u8(p.green);
+        reader.read_u8(p.blue);
+        reader.read_u16(p.hue);
+        reader.read_u16(x);
+        reader.read_u16(y);
+        reader.read_u16(width);
+        reader.read_u16(height);
+        reader.read_string(nick);
+        reader.read_string(room_id);
+        if (!reader.ok() || !is_process(gateway)) return;
+
+        p.nick = nick;
+        p.screen = game::screen_scale(width, height);
+        set_type(p, type);
+
+        if (gateway == m_process) {
+            // back where its client is, frames go straight to the session again
+            auto it = m_remote_players.find(p.id);
+            if (it != m_remote_players.end()) {
+                p.session = it->second;
+                m_remote_players.erase(it);
+            }
+        } else {
+            // only now, so nothing the gateway sends here can overtake the adoption
+            p.gateway = gateway;
+
+            std::vector<uint8_t> message = network::bus::message(network::bus_op::moved, 3);
+            network::bus::put_u16(message, p.id);
+            network::bus::put_u8(message, m_process);
+            m_bus->send(gateway, std::move(message));
+        }
+
+        m_owners[p.id].store(m_process);
+        host_player(std::move(p), std::string(room_id), x, y, true);
+    }
+
+    void on_bus_close(network::packet_reader &reader) {
+        uint16_t id, code;
+        reader.read_u16(id);
+        reader.read_u16(code);
+        if (!reader.ok()) return;
+
+        auto it = m_remote_players.find(id);
+        if (it == m_remote_players.end()) return;
+
+        auto s = it->second.lock();
+        if (!s) return;
+
+        websocketpp::lib::error_code ec;
+        m_server.close(s->hdl, code, "", ec);
+    }
+
+    void on_bus_release(network::packet_reader &reader) {
+        uint16_t id;
+        if (reader.read_u16(id)) m_player_ids.release(id);
+    }
+
+    void on_bus_screen(network::packet_reader &reader) {
+        uint16_t id, width, height;
+        reader.read_u16(id);
+        reader.read_u16(width);
+        reader.read_u16(height);
+        if (!reader.ok() || width == 0 || height == 0) return;
+
+        update_screen(id, game::screen_scale(width, height));
+    }
+
+    // a gateway dropped cursor frames for the player's client
+    void on_bus_resync(network::packet_reader &reader) {
+        uint16_t id;
+        if (!reader.read_u16(id)) return;
+
+        post_to_player(id, [this](shard &sh, game::player &p) {
+            send_positions(sh, p);
+        });
+    }
+
+    void run(uint16_t port) {
+        if (m_bus) {
+            // every process listens on the port and the kernel spreads the connections
+            m_server.set_reuse_addr(true);
+            m_server.set_tcp_pre_bind_handler([](std::shared_ptr<websocketpp::lib::asio::ip::tcp::acceptor> acceptor) {
+                int on = 1;
+                if (setsockopt(acceptor->native_handle(), SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0) {
+                    return websocketpp::lib::error_code(errno, std::system_category());
+                }
+                return websocketpp::lib::error_code();
+            });
+
+            m_bus->start([this](uint8_t from, uint8_t op, network::packet_reader &reader) {
+                on_bus(from, op, reader);
+            });
+        }
+
+        m_server.listen(port);
+        m_server.start_accept();
+
+        // socket reads, writes and frame parsing spread over the I/O threads
+        std::vector<std::thread> io_threads;
+        for (uint16_t i = 1; i < m_io_threads; i++) {
+            io_threads.emplace_back([this]() { m_server.run(); });
+        }
+        m_server.run();
+
+        for (std::thread &t: io_threads) t.join();
+    }
+
+    void shutdown() {
+        m_server.stop_listening();
+
+        for (auto &sh: m_shards) {
+            sh->io.stop();
+        }
+    }
+
+private:
+    server m_server;
+    uint16_t m_io_threads;
+    // Sessions, the bus, deadlines and the rest of the per-process state are
+    // only touched from handlers on this strand, so however many I/O threads
+    // run m_server they see one thread; it is what "network thread" means here.
+    std::unique_ptr<websocketpp::lib::asio::io_service::strand> m_network;
+
+    server::elog_type &elog;
+    // packet and session events, written off the network thread
+    utils::logger m_log;
+    
+    // Each shard owns the rooms that hash to it: their players, chat history,
+    // note batches and tick all live on the shard's own thread. The network
+    // thread only parses packets and posts the game work to the owning shard.
+    struct shard {
+        shard(uint16_t index, std::chrono::steady_clock::duration tick_interval) : index(index), work(io),
+            world(tick_interval), players(0), rooms(0), ops(0), tick_us(0) {}
+
+        uint16_t index;
+        websocketpp::lib::asio::io_service io;
+        websocketpp::lib::asio::io_service::work work;
+        std::thread thread;
+
+        game::game_manager world;
+
+        std::chrono::steady_clock::time_point next_tick;
+        std::unique_ptr<websocketpp::lib::asio::steady_timer> tick_timer;
+
+        // load, written by the shard and read by the report on the network thread
+        std::atomic<uint32_t> players, rooms;
+        std::atomic<uint64_t> ops;
+        std::atomic<uint32_t> tick_us;
+
+        // local sessions with frames still waiting in their outbox, and the
+        // player each one is for, since the session's player_id is the network thread's
+        struct backlogged {
+            std::shared_ptr<network::session> session;
+            uint16_t player;
+        };
+        std::vector<backlogged> backlog;
+
+        // per gateway process, players a frame is being relayed to
+        std::vector<std::vector<uint16_t>> relays;
+
+        // scratch for view diffs: a room's members, and the ids a client shows
+        utils::id_set members, shown;
+
+        // written by the shard, read by the metrics page on the network thread
+        utils::histogram tick_duration_us;
+        utils::histogram sends_per_event;
+        utils::histogram fanout_us;
+        utils::counter backlog_sessions, backlog_bytes;
+
+        // cursor moves from the network strand, applied when the tick starts.
+        // One entry per player, a newer move overwrites the one staged before it
+        struct staged_input {
+            uint16_t player, x, y;
+        };
+        std::mutex inputs_mutex;
+        std::vector<staged_input> inputs;
+        // per player, its entry in inputs plus one, 0 while none is staged
+        std::unique_ptr<uint32_t[]> input_at{new uint32_t[65536]()};
+        // the tick swaps inputs out into this, so once warm neither side allocates
+        std::vector<staged_input> draining;
+
+        // members per room, published once a second
+        uint32_t ticks_since_publish = 0;
+        // idle chat logs are looked for once an hour
+        uint32_t ticks_since_reap = 0;
+        std::mutex room_members_mutex;
+        std::vector<std::pair<std::string, uint32_t>> room_members;
+    };
+
+    std::vector<std::unique_ptr<shard>> m_shards;
+    std::chrono::steady_clock::duration m_tick_interval;
+
+    // Processes sharing the port each own the rooms that hash to them, and
+    // each hands out its own slice of the player ids. A client's packets are
+    // forwarded to the process hosting its player, whose broadcasts come back
+    // over the bus; one process runs without a bus.
+    uint8_t m_process, m_process_count;
+    std::unique_ptr<network::bus> m_bus;
+    // id -> process hosting the player, flipped by the host when it changes to another process' room
+    std::unique_ptr<std::atomic<uint8_t>[]> m_owners{new std::atomic<uint8_t>[65536]()};
+    // this process' clients whose player is hosted elsewhere, network thread only
+    std::unordered_map<uint16_t, network::session_ptr> m_remote_players;
+    // stands in for remote clients while their forwarded packets are handled
+    network::session m_forwarded;
+    uint8_t m_forwarded_gateway = 0;
+
+    // player ids are global so a player keeps its id when it moves between shards
+    utils::id_allocator m_player_ids;
+    // id -> index of the shard that owns the player, flipped by the shard on migration
+    std::unique_ptr<std::atomic<uint16_t>[]> m_routes{new std::atomic<uint16_t>[65536]()};
+
+    std::unique_ptr<websocketpp::lib::asio::steady_timer> m_report_timer;
+    // handshake, keepalive and idle deadlines of every session, on one timer
+    utils::timing_wheel<network::session *> m_deadlines;
+    std::unique_ptr<websocketpp::lib::asio::steady_timer> m_deadline_timer;
+    std::unique_ptr<websocketpp::lib::asio::steady_timer> m_metrics_timer;
+
+    // remote clients with frames still waiting in their outbox, flushed on the
+    // network thread every tick interval; network thread only
+    std::vector<std::shared_ptr<network::session>> m_relay_backlog;
+    std::unique_ptr<websocketpp::lib::asio::steady_timer> m_relay_timer;
+
+    // per opcode, network thread only
+    std::array<utils::counter, 256> m_packets;
+    std::array<utils::counter, 256> m_packet_bytes;
+    uint64_t m_reported_ops = 0;
+
+    // histories come back from their logs as their rooms are created again, so
+    // nothing is mapped up front
+    void use_log_dir(const std::string &log_dir) {
+        mkdir(log_dir.c_str(), 0755);
+
+        struct stat st;
+        if (stat(log_dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+            elog.write(websocketpp::log::elevel::warn, "can't use " + log_dir + " for chat logs, history stays in memory");
+            return;
+        }
+
+        // shards haven't started yet, so their worlds can be set from here
+        for (auto &sh: m_shards) {
+            sh->world.log_dir = log_dir;
+        }
+
+        elog.write(websocketpp::log::elevel::info, "chat logs in " + log_dir);
+    }
+
+    uint16_t shard_of(const std::string &room_id) {
+        return std::hash<std::string>()(room_id) % m_shards.size();
+    }
+
+    // FNV-1a, not the shard hash, so one process' rooms still spread over all its shards
+    uint8_t owner_of(const std::string &room_id) {
+        uint32_t hash = 2166136261u;
+        for (char c: room_id) {
+            hash = (hash ^ static_cast<uint8_t>(c)) * 16777619u;
+        }
+        return hash % m_process_count;
+    }
+
+    // the first id of process' slice, asking for the one past the last gives 65536
+    static uint32_t first_player_id(uint32_t process, uint32_t process_count) {
+        if (process == process_count) return 65536;
+        return 1 + process * (65535 / process_count);
+    }
+
+    // runs op on the shard that owns the player, following it if it migrated while the op was queued
+    void post_to_player(uint16_t id, std::function<void(shard &, game::player &)> op) {
+        shard &sh = *m_shards[m_routes[id].load()];
+        sh.io.post([this, &sh, id, op = std::move(op)]() {
+            game::player *p = sh.world.players.find(id);
+            if (!p) {
+                if (m_routes[id].load() != sh.index) post_to_player(id, op);
+                return;
+            }
+
+            sh.ops++;
+            op(sh, *p);
+        });
+    }
+
+    // the player's latest cursor position, for its shard's next tick. Per packet
+    // this is a lock and a store, no op is queued
+    void stage_input(uint16_t id, uint16_t x, uint16_t y) {
+        shard &sh = *m_shards[m_routes[id].load()];
+        std::lock_guard<std::mutex> lock(sh.inputs_mutex);
+
+        uint32_t &at = sh.input_at[id];
+        if (at) {
+            sh.inputs[at - 1].x = x;
+            sh.inputs[at - 1].y = y;
+            return;
+        }
+
+        sh.inputs.push_back({id, x, y});
+        at = static_cast<uint32_t>(sh.inputs.size());
+    }
+
+    // moves staged since the last tick, following players that migrated
+    // meanwhile the way post_to_player does
+    void apply_inputs(shard &sh) {
+        {
+            std::lock_guard<std::mutex> lock(sh.inputs_mutex);
+            for (const auto &input: sh.inputs) sh.input_at[input.player] = 0;
+            sh.draining.swap(sh.inputs);
+        }
 
-        m_server.clear_access_channels(websocketpp::log::alevel::all);
+        for (const auto &input: sh.draining) {
+            game::player *p = sh.world.players.find(input.player);
+            if (!p) {
+                if (m_routes[input.player].load() != sh.index) stage_input(input.player, input.x, input.y);
+                continue;
+            }
 
-        alog = m_server.get_alog();
-        elog = m_server.get_elog();
+            sh.ops++;
+            game::room *room = sh.world.room_of(*p);
+            if (room) room->cursors.stage(p->room_slot, input.x, input.y);
+        }
+        sh.draining.clear();
     }
 
-    void start_loop() {}
+    void change_room(shard &sh, game::player &p, const std::string &room_id) {
+        uint16_t x = 300, y = 400;
+        uint32_t left = p.room;
+        if (game::room *room = sh.world.room_of(p)) {
+            x = room->cursors.x[p.room_slot];
+            y = room->cursors.y[p.room_slot];
+        }
 
-    void process_message(std::string &buffer, connection_hdl hdl) {
-        auto s = m_sessions[hdl];
+        // the client drops the old room before it is sent the new one
+        send_farewell(sh, p);
+        sh.world.leave_room(p);
+        dispatch_left_room(sh, p.id, left);
 
-        switch(buffer[0]) {
-            case network::opcode::ping:
-            {
-                alog.write(websocketpp::log::alevel::app, "ping!");
-                m_server.send(hdl, {0}, 1, websocketpp::frame::opcode::binary);
-                alog.write(websocketpp::log::alevel::app, "I sent a pong as a response.");
-                
-                if(!s->received_ping) s->received_ping = true;
-                
-                break;
-            }
+        uint8_t owner = owner_of(room_id);
+        if (owner != m_process) {
+            hand_over(sh, p, owner, room_id, x, y);
+            return;
+        }
 
-            case network::opcode::hello:
-            {
-                if(buffer.length() >= 5) {
-                    alog.write(websocketpp::log::alevel::app, "hello!");
-                    std::memcpy(&s->screen_width, &buffer[1], 2);
-                    std::memcpy(&s->screen_height, &buffer[3], 2);
+        uint16_t target = shard_of(room_id);
+        if (target == sh.index) {
+            enter_room(sh, p, room_id, x, y, false);
+            return;
+        }
 
-                    if(!s->received_hello) s->received_hello = true;
+        // migrate: the new shard adopts the player, then the route flips. Ops
+        // that see the new route were queued after the adoption, so they find it.
+        uint16_t id = p.id;
+        shard &next = *m_shards[target];
+        next.io.post([this, &next, moving = sh.world.remove_player(id), room_id, x, y]() mutable {
+            game::player &adopted = next.world.add_player(std::move(moving));
+            enter_room(next, adopted, room_id, x, y, false);
+        });
 
-                    s->type = network::session_type::player;
+        m_routes[id].store(target);
+    }
 
-                    if(s->screen_width == 0 || s->screen_height == 0) {
-                        alog.write(websocketpp::log::alevel::app, "screen 0x0, closing the connection");
-                        m_server.close(hdl, websocketpp::close::status::normal, "");
-                    }
-                } else {
-                    alog.write(websocketpp::log::alevel::app, "hello packet is too short... closing the connection.");
-                    m_server.close(hdl, websocketpp::close::status::normal, "");
-                }
-                break;
-            }
+    // joins the room and catches the player's client up with it. A player
+    // coming from another room announces itself as entering the room, not the game
+    void enter_room(shard &sh, game::player &p, const std::string &room_id, uint16_t x, uint16_t y, bool entered_game) {
+        bool created = sh.world.join_room(p, room_id, x, y);
+        if (entered_game) {
+            dispatch_entered_game(sh, p.id, p.room);
+        } else {
+            dispatch_entered_room(sh, p.id, p.room);
+        }
 
-            case network::opcode::hello_bot:
-            {
-                if(buffer.length() >= 5) {
-                    alog.write(websocketpp::log::alevel::app, "hello bot!");
-                    std::memcpy(&s->screen_width, &buffer[1], 2);
-                    std::memcpy(&s->screen_height, &buffer[3], 2);
-
-                    if(!s->received_hello) s->received_hello = true;
-
-                    s->type = network::session_type::bot;
-                    
-                    if(s->screen_width == 0 || s->screen_height == 0) {
-                        alog.write(websocketpp::log::alevel::app, "screen 0x0, closing the connection");
-                        m_server.close(hdl, websocketpp::close::status::normal, "");
-                    }
-                } else {
-                    alog.write(websocketpp::log::alevel::app, "hello packet is too short... closing the connection.");
-                    m_server.close(hdl, websocketpp::close::status::normal, "");
-                }
-                break;
-            }
+        send_room_info(sh, p, created ? network::event::created_room : network::event::updated_room);
+        send_snapshot(sh, p);
+        send_history(sh, p);
+    }
 
-            case network::opcode::hello_debug:
-            {
-                if(buffer.length() >= 5) {
-                    alog.write(websocketpp::log::alevel::app, "hello debug!");
-                    std::memcpy(&s->screen_width, &buffer[1], 2);
-                    std::memcpy(&s->screen_height, &buffer[3], 2);
-
-                    int offset = 5;
-                    try {
-                        std::string pass = utils::getString(buffer, offset);
-                        if(pass == "plsadmin")
-                            s->type = network::session_type:dev;
-                        else
-                            s->type = network::session_type::player;
-                    } catch(std::out_of_range &e) {
-                        alog.write(websocketpp::log::alevel::app, "invalid debug packet, closing the connection");
-                        return;
-                    }
-
-                    if(!s->received_hello) s->received_hello = true;
-
-                    if(s->screen_width == 0 || s->screen_height == 0) {
-                        alog.write(websocketpp::log::alevel::app, "screen 0x0, closing the connection");
-                        m_server.close(hdl, websocketpp::close::status::normal, "");
-                    }
-                } else {
-                    alog.write(websocketpp::log::alevel::app, "hello packet is too short... closing the connection.");
-                    m_server.close(hdl, websocketpp::close::status::normal, "");
-                }
-                break;
-            }
+    // tells the members, then sends them all back to the lobby, wherever it is hosted
+    void delete_room(shard &sh, uint32_t index) {
+        game::room &room = sh.world.rooms[index];
+        if (room.name == game::lobby) return;
 
-            case network::opcode::enter_game:
-            {
-                if(buffer.size() < 8) {
-                    alog.write(websocketpp::log::alevel::app, "invalid enter game packet! (too short), closing the connection");
-                    m_server.close(hdl, websocketpp::close::status::normal, "");
-                    
-                    return;
-                }
+        uint8_t buffer[network::event_size];
+        send_dispatch(sh, buffer, network::encode_event(buffer, network::event::deleted_room, room.owner_id), index);
 
-                if(s->did_enter_game() || !s->did_send_hello()) {
-                    alog.write(websocketpp::log::alevel::app, "not the right time to enter the game! closing the connection");
-                    m_server.close(hdl, websocketpp::close::status::normal, "");
-                    
-                    return;
-                }
-                
-                auto p = std::make_shared<game::player>();
-                p->session = std::weak_ptr(s);
-                s->player = p;
-
-                switch(s->type) {
-                    case network::session_type::player:
-                    s->player->is_player = true;
-                    break;
-
-                    case network::session_type::bot:
-                    s->player->is_bot = true;
-                    break;
-
-                    case network::session_type::dev:
-                    s->player->is_dev = true;
-                    break;
-                }
+        std::vector<uint16_t> members = room.cursors.id;
+        for (uint16_t id: members) {
+            change_room(sh, *sh.world.players.find(id), game::lobby);
+        }
 
-                p->id = game_world.add_player(p);
+        // the history goes with the room, not to the next one by that name
+        sh.world.delete_log(room.name);
+        sh.world.rooms.release(index, false);
+    }
 
-                uint8_t data[3];
-                data[0] = network::opcode::entered_game;
-                std::memcpy(&data[1], &p->id, 2);
+    // moves the player to the process that owns its new room. Its client stays
+    // where it is, this process forwards whatever the gateway sends here until
+    // the new owner has told the gateway about itself
+    void hand_over(shard &sh, game::player &p, uint8_t owner, const std::string &room_id, uint16_t x, uint16_t y) {
+        uint16_t id = p.id;
+        game::player moving = sh.world.remove_player(id);
+        uint8_t gateway = moving.gateway;
+
+        if (gateway == game::player::local) {
+            gateway = m_process;
+            m_network->post([this, id, session = moving.session]() {
+                m_remote_players[id] = session;
+            });
+        }
 
-                m_server.send(hdl, data, sizeof(data), websocketpp::frame::opcode::binary);
+        std::vector<uint8_t> message = network::bus::message(network::bus_op::adopt, 18 + moving.nick.size() + room_id.size() + 2);
+        network::bus::put_u16(message, id);
+        network::bus::put_u8(message, gateway);
+        network::bus::put_u8(message, type_of(moving));
+        network::bus::put_u8(message, moving.red);
+        network::bus::put_u8(message, moving.green);
+        network::bus::put_u8(message, moving.blue);
+        network::bus::put_u16(message, moving.hue);
+        network::bus::put_u16(message, x);
+        network::bus::put_u16(message, y);
+        network::bus::put_u16(message, moving.screen.width);
+        network::bus::put_u16(message, moving.screen.height);
+        network::bus::put_string(message, moving.nick);
+        network::bus::put_string(message, room_id);
+        m_bus->send(owner, std::move(message));
+
+        m_owners[id].store(owner);
+    }
 
-                try {
-                    int offset = 1;
-                    
-                    p->red = buffer[offset++];
-                    p->green = buffer[offset++];
-                    p->blue = buffer[offset++];
-                    
-                    p->nick = utils::getString(buffer, offset);
-                    p->room_id = utils::getString(buffer, offset);
+    void schedule_tick(shard &sh) {
+        sh.next_tick += m_tick_interval;
+        sh.tick_timer->expires_at(sh.next_tick);
+        sh.tick_timer->async_wait([this, &sh](websocketpp::lib::asio::error_code const & ec) {
+            on_tick(sh, ec);
+        });
+    }
 
-                    if(p->room_id == "") p->room_id = "lobby";
+    void on_tick(shard &sh, websocketpp::lib::asio::error_code const & ec) {
+        if (ec) return;
 
-                    dispatch_entered_game(p->id, p->room_id);
-                    
-                } catch(std::out_of_range &e) {
-                    alog.write(websocketpp::log::alevel::app, "invalid enter game packet! closing the connection");
-                    m_server.close(hdl, websocketpp::close::status::normal, "");
-                }
-                
-                break;
-            }
+        tick(sh);
 
-            case network::opcode::leave_game:
-            {
-                if(!s->did_enter_game()) {
-                    alog.write(websocketpp::log::alevel::app, "can't leave the game without entering it first");
-                    return;
-                }
+        // don't try to catch up after a stall, just start counting from now
+        auto now = std::chrono::steady_clock::now();
+        if (sh.next_tick + m_tick_interval < now) sh.next_tick = now;
+
+        schedule_tick(sh);
+    }
+
+    void tick(shard &sh) {
+        auto started = std::chrono::steady_clock::now();
 
-                s->player->deletion_reason = 0x03;
-                game_world.mark_for_deletion(s->player->id);
-                dispatch_left_game(p->id, p->room_id);
-                break;
+        apply_inputs(sh);
+
+        game::room_registry &rooms = sh.world.rooms;
+        for (uint32_t index = 0; index < rooms.capacity(); index++) {
+            game::room &room = rooms[index];
+            if (!room.live) continue;
+
+            game::cursor_block &cursors = room.cursors;
+            game::normalize(cursors);
+
+            if (room.changed) {
+                // someone joined or left, members catch up with the room as it is now
+                dispatch_views(sh, index);
+                room.seen = cursors.id;
+                room.farewell.reset();
+            } else {
+                // everyone already sees everyone, only movement needs to go out
+                dispatch_cursors(sh, index);
             }
+            std::fill(cursors.moved.begin(), cursors.moved.end(), 0);
 
-            case network::opcode::resize:
-            {
-                if(buffer.length() >= 5) {
-                    alog.write(websocketpp::log::alevel::app, "resize!");
-                    std::memcpy(&s->screen_width, &buffer[1], 2);
-                    std::memcpy(&s->screen_height, &buffer[3], 2);
-
-                    if(s->screen_width == 0 || s->screen_height == 0) {
-                        alog.write(websocketpp::log::alevel::app, "screen 0x0, closing the connection");
-                        m_server.close(hdl, websocketpp::close::status::normal, "");
-                    }
-                } else {
-                    alog.write(websocketpp::log::alevel::app, "resize packet is too short... closing the connection.");
-                    m_server.close(hdl, websocketpp::close::status::normal, "");
-                }
-                break;
+            if (room.info_changed) {
+                uint8_t buffer[network::room_info_size];
+                send_dispatch(sh, buffer, encode_room_info(buffer, network::event::updated_room, room), index);
             }
 
-            case network::opcode::input:
-            {
-                if(!s->did_enter_game()) {
-                    alog.write(websocketpp::log::alevel::app, "can't move your cursor without entering the game first");
-                    return;
-                }
-                
-                if(buffer.length() >= 5) {
-                    std::memcpy(&s->player->x, &buffer[1], 2);
-                    std::memcpy(&s->player->y, &buffer[3], 2);
-                } else {
-                    alog.write(websocketpp::log::alevel::app, "cursor packet is too short... closing the connection.");
-                    m_server.close(hdl, websocketpp::close::status::normal, "");
-                }
-                
-                break;
+            if (!room.notes.notes.empty()) {
+                dispatch_notes(sh, room.notes.notes, index);
+                room.notes.notes.clear();
             }
 
-            case network::opcode::nick:
-            {
-                if(!s->did_enter_game()) {
-                    alog.write(websocketpp::log::alevel::app, "can't change your nick without entering the game first");
-                    return;
-                }
+            room.changed = false;
+            room.info_changed = false;
+            room.snapshot = game::room_snapshot();
+        }
 
-                if(buffer.size() > 1 + 2 && buffer.size() < 1 + 15 + 3) {
-                    try {
-                        int offset = 1;
-                        p->nick = utils::getString(buffer, offset);
-                        dispatch_nick(p->id, p->nick, p->room_id);
-                    } catch(std::out_of_range &e) {
-                        alog.write(websocketpp::log::alevel::app, "invalid nick packet! closing the connection");
-                        m_server.close(hdl, websocketpp::close::status::normal, "");
-                    }
-                } else {
-                    alog.write(websocketpp::log::alevel::app, "invalid nick packet (too short).");
-                    m_server.close(hdl, websocketpp::close::status::normal, "");
-                }
-                
-                break;
+        std::vector<uint16_t> released;
+        sh.world.delete_pending(started, [this, &released](const game::player &p) {
+            if (p.gateway == game::player::local) {
+                released.push_back(p.id);
+                return;
             }
 
-            case network::opcode::color:
-            {
-                if(!s->did_enter_game()) {
-                    alog.write(websocketpp::log::alevel::app, "can't change your color without entering the game first");
-                    return;
-                }
+            // the id came from the gateway's slice
+            std::vector<uint8_t> message = network::bus::message(network::bus_op::release, 2);
+            network::bus::put_u16(message, p.id);
+            m_bus->send(p.gateway, std::move(message));
+        });
+
+        if (!released.empty()) {
+            // ids belong to the network thread, hand them back once the player is really gone
+            m_network->post([this, released]() {
+                for (uint16_t id: released) m_player_ids.release(id);
+            });
+        }
 
-                if(buffer.size() == 1 + 3) {
-                    int offset = 1;
-                    s->player->red = buffer[offset++];
-                    s->player->green = buffer[offset++];
-                    s->player->blue = buffer[offset++];
+        // rooms emptied this tick go now, nothing holds their index any more
+        rooms.reclaim();
 
-                    dispatch_color(p->id, s->player->red, s->player->green, s->player->blue, s->room_id);
-                }
-                
-                break;
-            }
+        flush_backlog(sh);
 
-            case network::opcode::chat:
-            {
-                if(!s->did_enter_game()) {
-                    alog.write(websocketpp::log::alevel::app, "can't chat without entering the game first");
-                    return;
-                }
+        sh.players = sh.world.players.size();
+        sh.rooms = rooms.size();
+        sh.tick_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - started).count();
+        sh.tick_duration_us.record(sh.tick_us);
 
-                if(buffer.size() > 1 + 500 + 3) {
-                    alog.write(websocketpp::log::alevel::app, "message too long!");
-                    return;
-                }
+        if (++sh.ticks_since_publish * m_tick_interval >= std::chrono::seconds(1)) {
+            sh.ticks_since_publish = 0;
 
-                try {
-                    std::string chat_message = utils::getString(buffer, offset);
-                    if(chat_message == "") {
-                        alog.write(websocketpp::log::alevel::app, "null message!");
-                        return;
-                    }
-
-
-                    dispatch_message(chat_message, s->player->id, s->player->nick, s->player->room_id);
-
-                    game_world.add_message(s->player->room_id, {
-                        chat_message,
-                        s->player->nick,
-                        s->player->hue,
-                        s->player->id,
-                        std::chrono::duration<double>(std::chrono::system_clock::now().time_since_epoch()).count()
-                    });
-                } catch(std::out_of_range &e) {
-                    alog.write(websocketpp::log::alevel::app, "Invalid message! closing connection");
-                    m_server.close(hdl, websocketpp::close::status::normal, "");
-                }
-                
-                break;
+            std::lock_guard<std::mutex> lock(sh.room_members_mutex);
+            sh.room_members.clear();
+            for (uint32_t index = 0; index < rooms.capacity(); index++) {
+                game::room &room = rooms[index];
+                if (room.live) sh.room_members.emplace_back(room.name, static_cast<uint32_t>(room.members()));
             }
+        }
 
-            case network::opcode::change_room:
-            {
-                if(!s->did_enter_game()) {
-                    alog.write(websocketpp::log::alevel::app, "can't change your room without entering the game first");
-                    return;
-                }
+        // every shard of every process sharing the directory sees all the logs,
+        // each only deletes those of rooms it hosts
+        if (++sh.ticks_since_reap * m_tick_interval >= std::chrono::hours(1)) {
+            sh.ticks_since_reap = 0;
+            sh.world.reap_logs(game::game_manager::log_idle_cutoff, [this, &sh](const std::string &room_id) {
+                return owner_of(room_id) == m_process && shard_of(room_id) == sh.index;
+            });
+        }
+    }
 
-                try {
-                    int offset = 1;
-                    std::string room_id = utils::getString(buffer, offset);
-                    if(room_id == "") {
-                        alog.write(websocketpp::log::alevel::app, "null room id! closing connection");
-                        m_server.close(hdl, websocketpp::close::status::normal, "");
-                        return;
-                    } else {
-                        dispatch_left_room(s->player->id, s->player->room_id);
-                        s->player->room_id = room_id;
-                        dispatch_entered_room(s->player->id, s->player->room_id);
-                    }
-                } 
-                catch(std::out_of_range &e) {
-                    alog.write(websocketpp::log::alevel::app, "Invalid message! closing connection");
-                    m_server.close(hdl, websocketpp::close::status::normal, "");
-                }
-                
-                break;
-            }
+    void on_http(connection_hdl hdl) {
+        server::connection_ptr con = m_server.get_con_from_hdl(hdl);
 
-            case network::opcode::update_room:
-            {
-                if(!s->did_enter_game()) {
-                    alog.write(websocketpp::log::alevel::app, "can't update your room without entering the game first");
-                    return;
-                }
-                
-                break;
-            }
+        if (con->get_resource() != "/metrics") {
+            con->set_status(websocketpp::http::status_code::not_found);
+            return;
+        }
 
-            case network::opcode::delete_room:
-            {
-                if(!s->did_enter_game()) {
-                    alog.write(websocketpp::log::alevel::app, "can't delete your room without entering the game first");
-                    return;
-                }
-                break;
-            }
+        con->set_status(websocketpp::http::status_code::ok);
+        con->append_header("Content-Type", "text/plain; version=0.0.4");
+        con->set_body(render_metrics());
+    }
 
-            case network::opcode::note:
-            {
-                if(!s->did_enter_game()) {
-                    alog.write(websocketpp::log::alevel::app, "can't play notes without entering the game first");
-                    return;
-                }
-                
-                break;
+    void schedule_metrics_stream() {
+        m_metrics_timer->expires_at(std::chrono::steady_clock::now() + std::chrono::seconds(1));
+        m_metrics_timer->async_wait(m_network->wrap([this](websocketpp::lib::asio::error_code const & ec) {
+            if (ec) return;
+            stream_metrics();
+            schedule_metrics_stream();
+        }));
+    }
+
+    // metrics: [opcode][exposition text], only to dev sessions that asked
+    void stream_metrics() {
+        std::vector<uint8_t> buffer;
+
+        for (network::session *s: m_sessions) {
+            if (!s->metrics_stream || s->type != network::session_type::dev) continue;
+
+            if (buffer.empty()) {
+                std::string text = render_metrics();
+                buffer.reserve(1 + text.size());
+                buffer.push_back(network::opcode::metrics);
+                buffer.insert(buffer.end(), text.begin(), text.end());
             }
 
-            case network::opcode::debug_ban:
-            {
-                if(!s->did_enter_game()) {
-                    alog.write(websocketpp::log::alevel::app, "can't ban without entering the game first");
-                    return;
-                }
-                
-                break;
+            connection_of(*s).send(buffer.data(), buffer.size(), websocketpp::frame::opcode::binary);
+        }
+    }
+
+    std::string render_metrics() {
+        utils::exposition out;
+
+        out.type("mpp_packets_total", "counter");
+        for (size_t op = 0; op < 256; op++) {
+            if (m_packets[op].get() == 0) continue;
+            out.sample("mpp_packets_total", utils::exposition::hex_label("opcode", op), m_packets[op].get());
+        }
+
+        out.type("mpp_packet_bytes_total", "counter");
+        for (size_t op = 0; op < 256; op++) {
+            if (m_packets[op].get() == 0) continue;
+            out.sample("mpp_packet_bytes_total", utils::exposition::hex_label("opcode", op), m_packet_bytes[op].get());
+        }
+
+        out.type("mpp_sessions", "gauge");
+        out.sample("mpp_sessions", "", m_sessions.size());
+
+        out.type("mpp_session_deadlines", "gauge");
+        out.sample("mpp_session_deadlines", "", m_deadlines.size());
+
+        out.type("mpp_players", "gauge");
+        for (auto &sh: m_shards) {
+            out.sample("mpp_players", shard_label(*sh), sh->players.load());
+        }
+
+        out.type("mpp_ops_total", "counter");
+        for (auto &sh: m_shards) {
+            out.sample("mpp_ops_total", shard_label(*sh), sh->ops.load());
+        }
+
+        out.type("mpp_backlog_sessions", "gauge");
+        for (auto &sh: m_shards) {
+            out.sample("mpp_backlog_sessions", shard_label(*sh), sh->backlog_sessions.get());
+        }
+
+        out.type("mpp_backlog_bytes", "gauge");
+        for (auto &sh: m_shards) {
+            out.sample("mpp_backlog_bytes", shard_label(*sh), sh->backlog_bytes.get());
+        }
+
+        out.type("mpp_room_members", "gauge");
+        for (auto &sh: m_shards) {
+            std::lock_guard<std::mutex> lock(sh->room_members_mutex);
+            for (auto &room: sh->room_members) {
+                out.sample("mpp_room_members", utils::exposition::label("room", room.first), room.second);
             }
+        }
 
-            case network::opcode::debug_mute:
-            {
-                if(!s->did_enter_game()) {
-                    alog.write(websocketpp::log::alevel::app, "can't mute without entering the game first");
-                    return;
-                }
-                break;
+        if (m_bus) {
+            out.type("mpp_bus_messages_total", "counter");
+            out.sample("mpp_bus_messages_total", utils::exposition::label("result", "sent"), m_bus->sent.get());
+            out.sample("mpp_bus_messages_total", utils::exposition::label("result", "received"), m_bus->received.get());
+            out.sample("mpp_bus_messages_total", utils::exposition::label("result", "dropped"), m_bus->dropped.get());
+
+            out.type("mpp_remote_players", "gauge");
+            out.sample("mpp_remote_players", "", m_remote_players.size());
+        }
+
+        // histograms are merged across shards
+        render_histogram(out, "mpp_tick_duration_us", &shard::tick_duration_us);
+        render_histogram(out, "mpp_sends_per_event", &shard::sends_per_event);
+        render_histogram(out, "mpp_fanout_us", &shard::fanout_us);
+
+        return out.text;
+    }
+
+    static std::string shard_label(const shard &sh) {
+        return utils::exposition::label("shard", std::to_string(sh.index));
+    }
+
+    void render_histogram(utils::exposition &out, const char *name, utils::histogram shard::*member) {
+        std::vector<uint64_t> counts;
+        uint64_t sum = 0;
+        for (auto &sh: m_shards) {
+            ((*sh).*member).read(counts, sum);
+        }
+
+        out.type(name, "histogram");
+        out.histogram_samples(name, counts, sum);
+    }
+
+    void schedule_report() {
+        m_report_timer->expires_at(std::chrono::steady_clock::now() + std::chrono::seconds(10));
+        m_report_timer->async_wait(m_network->wrap([this](websocketpp::lib::asio::error_code const & ec) {
+            if (ec) return;
+            report_load();
+            schedule_report();
+        }));
+    }
+
+    void report_load() {
+        std::string line = "shard load:";
+        uint64_t total = 0;
+
+        for (auto &sh: m_shards) {
+            uint64_t ops = sh->ops.load();
+            total += ops;
+            line += " [" + std::to_string(sh->index) + "] "
+                + std::to_string(sh->players.load()) + " players, "
+                + std::to_string(sh->rooms.load()) + " rooms, "
+                + std::to_string(ops) + " ops, tick "
+                + std::to_string(sh->tick_us.load()) + "us";
+        }
+
+        line += " (" + std::to_string((total - m_reported_ops) / 10) + " ops/s)";
+        m_reported_ops = total;
+
+        elog.write(websocketpp::log::elevel::info, line);
+    }
+
+    // open sessions, for iteration only
+    network::session_registry m_sessions;
+    uint32_t m_next_session_id = 0;
+    network::flood_limits m_flood_limits;
+    // remote addresses banned by devs, until restart
+    std::unordered_set<std::string> m_banned;
+
+    void dispatch_entered_game(shard &sh, uint16_t id, uint32_t room) {
+        uint8_t buffer[network::event_size];
+        send_dispatch(sh, buffer, network::encode_event(buffer, network::event::entered_game, id), room);
+    }
+
+    void dispatch_left_game(shard &sh, uint16_t id, uint32_t room) {
+        uint8_t buffer[network::event_size];
+        send_dispatch(sh, buffer, network::encode_event(buffer, network::event::left_game, id), room);
+    }
+
+    void dispatch_message(shard &sh, const std::string &value, uint16_t id, std::string &nick, uint32_t room) {
+        std::vector<uint8_t> buffer;
+        network::encode_message(buffer, id, nick, value);
+        send_dispatch(sh, buffer.data(), buffer.size(), room);
+    }
+
+    void dispatch_nick(shard &sh, uint16_t id, std::string &nick, uint32_t room) {
+        std::vector<uint8_t> buffer;
+        network::encode_nick(buffer, id, nick);
+        send_dispatch(sh, buffer.data(), buffer.size(), room);
+    }
+
+    void dispatch_color(shard &sh, uint16_t id, uint8_t red, uint8_t green, uint8_t blue, uint32_t room) {
+        uint8_t buffer[network::color_size];
+        send_dispatch(sh, buffer, network::encode_color(buffer, id, red, green, blue), room);
+    }
+
+    void dispatch_entered_room(shard &sh, uint16_t id, uint32_t room) {
+        uint8_t buffer[network::event_size];
+        send_dispatch(sh, buffer, network::encode_event(buffer, network::event::entered_room, id), room);
+    }
+
+    void dispatch_left_room(shard &sh, uint16_t id, uint32_t room) {
+        uint8_t buffer[network::event_size];
+        send_dispatch(sh, buffer, network::encode_event(buffer, network::event::left_room, id), room);
+    }
+
+    void encode_full_cursor(std::vector<uint8_t> &buffer, const game::player &p, uint16_t x, uint16_t y) {
+        uint8_t flag = network::cursor_flag::full;
+        if (p.is_bot) flag = network::cursor_flag::full_bot;
+        else if (p.is_dev) flag = network::cursor_flag::full_dev;
+
+        network::encode_full_cursor(buffer, p.id, x, y, flag, p.red, p.green, p.blue, p.nick);
+    }
+
+    static size_t encode_room_info(uint8_t *buffer, uint8_t event, const game::room &room) {
+        const game::room_settings &settings = room.settings;
+        return network::encode_room_info(buffer, event, room.owner_id, settings.flags, settings.red, settings.green, settings.blue);
+    }
+
+    void dispatch_cursors(shard &sh, uint32_t room) {
+        std::vector<uint8_t> buffer;
+        if (network::encode_moved(buffer, sh.world.rooms[room].cursors) == 0) return;
+
+        send_dispatch(sh, network::make_frame(buffer.data(), buffer.size()), room, network::outbox::cursors);
+    }
+
+    // every member's position as partial records, for sessions whose cursor frames were dropped
+    network::frame_ptr encode_positions(const game::cursor_block &room) {
+        std::vector<uint8_t> buffer;
+        network::encode_positions(buffer, room);
+        return network::make_frame(buffer.data(), buffer.size());
+    }
+
+    // the same through send_to, for a resync asked for by whoever flushes the
+    // client's outbox; it queues behind everything else, so it goes as reliable
+    void send_positions(shard &sh, const game::player &p) {
+        game::room *room = sh.world.room_of(p);
+        if (room) send_to(sh, p, encode_positions(room->cursors));
+    }
+
+    void dispatch_notes(shard &sh, std::vector<game::note> &notes, uint32_t room) {
+        std::vector<uint8_t> buffer;
+        network::encode_notes(buffer, notes);
+        send_dispatch(sh, buffer.data(), buffer.size(), room);
+    }
+
+    // Membership changed. Members that were in the room at the last tick all
+    // show room.seen and get one shared diff; this tick's joiners show the
+    // snapshot they were sent and get one diff per snapshot.
+    void dispatch_views(shard &sh, uint32_t index) {
+        game::room &room = sh.world.rooms[index];
+        const game::cursor_block &cursors = room.cursors;
+
+        sh.members.clear();
+        std::vector<const std::vector<uint16_t> *> snapshots;
+        for (uint16_t id: cursors.id) {
+            sh.members.insert(id);
+
+            const game::player &p = *sh.world.players.find(id);
+            if (p.view && std::find(snapshots.begin(), snapshots.end(), p.view.get()) == snapshots.end()) {
+                snapshots.push_back(p.view.get());
             }
+        }
 
-            case network::opcode::debug_kick:
-            {
-                if(!s->did_enter_game()) {
-                    alog.write(websocketpp::log::alevel::app, "can't kick without entering the game first");
-                    return;
-                }
-                
-                break;
+        if (network::frame_ptr frame = encode_view(sh, room.seen, cursors)) {
+            send_dispatch(sh, frame, index, network::outbox::reliable,
+                          [](const game::player &member) { return !member.view; });
+        }
+
+        for (const std::vector<uint16_t> *snapshot: snapshots) {
+            network::frame_ptr frame = encode_view(sh, *snapshot, cursors);
+            if (!frame) continue;
+
+            send_dispatch(sh, frame, index, network::outbox::reliable,
+                          [snapshot](const game::player &member) { return member.view.get() == snapshot; });
+        }
+
+        for (uint16_t id: cursors.id) {
+            sh.world.players.find(id)->view.reset();
+        }
+    }
+
+    // cursor records taking a client that shows the ids in shown to the room
+    // as it is: del for who left, full for who it lacks, partial for who moved.
+    // Null when there is nothing to send. sh.members holds the room's members
+    network::frame_ptr encode_view(shard &sh, const std::vector<uint16_t> &shown, const game::cursor_block &room) {
+        std::vector<uint8_t> buffer;
+        network::begin_cursors(buffer);
+        uint16_t count = 0;
+
+        sh.shown.clear();
+        for (uint16_t id: shown) {
+            sh.shown.insert(id);
+            if (sh.members.contains(id)) continue;
+
+            network::encode_cursor(buffer, id, 0, 0, network::cursor_flag::del);
+            count++;
+        }
+
+        for (size_t i = 0; i < room.size(); i++) {
+            uint16_t id = room.id[i];
+            if (!sh.shown.contains(id)) {
+                encode_full_cursor(buffer, *sh.world.players.find(id), room.x[i], room.y[i]);
+                count++;
+            } else if (room.moved[i]) {
+                network::encode_cursor(buffer, id, room.x[i], room.y[i], network::cursor_flag::partial);
+                count++;
             }
-            
-            default:
-            {
-                
-                break;
+        }
+
+        if (count == 0) return nullptr;
+        network::end_cursors(buffer, count);
+        return network::make_frame(buffer.data(), buffer.size());
+    }
+
+    static network::frame_ptr encode_farewell(const std::vector<uint16_t> &shown) {
+        std::vector<uint8_t> buffer;
+        network::begin_cursors(buffer);
+        for (uint16_t id: shown) {
+            network::encode_cursor(buffer, id, 0, 0, network::cursor_flag::del);
+        }
+        network::end_cursors(buffer, static_cast<uint16_t>(shown.size()));
+        return network::make_frame(buffer.data(), buffer.size());
+    }
+
+    // del records for everything the player's client shows of its room. Every
+    // member that was there at the last tick shares the room's farewell
+    void send_farewell(shard &sh, game::player &p) {
+        game::room *room = sh.world.room_of(p);
+        if (!room) return;
+
+        if (p.view) {
+            if (!p.view->empty()) send_to(sh, p, encode_farewell(*p.view));
+            p.view.reset();
+            return;
+        }
+
+        if (room->seen.empty()) return;
+        if (!room->farewell) room->farewell = encode_farewell(room->seen);
+        send_to(sh, p, room->farewell);
+    }
+
+    // the room as it is now, so the joiner doesn't wait for the next view diff
+    void send_snapshot(shard &sh, game::player &p) {
+        game::room *r = sh.world.room_of(p);
+        if (!r) return;
+        if (p.gateway == game::player::local && p.session.expired()) return;
+
+        game::room_snapshot &snapshot = r->snapshot;
+        if (!snapshot.frame) {
+            const game::cursor_block &room = r->cursors;
+
+            std::vector<uint8_t> buffer;
+            network::begin_cursors(buffer);
+
+            for (size_t i = 0; i < room.size(); i++) {
+                encode_full_cursor(buffer, *sh.world.players.find(room.id[i]), room.x[i], room.y[i]);
             }
+            network::end_cursors(buffer, static_cast<uint16_t>(room.size()));
+
+            snapshot.frame = network::make_frame(buffer.data(), buffer.size());
+            snapshot.ids = std::make_shared<const std::vector<uint16_t>>(room.id);
         }
+
+        p.view = snapshot.ids;
+        send_to(sh, p, snapshot.frame);
     }
 
-    void on_open(connection_hdl hdl) {
-        m_sessions[hdl] = std::make_shared<network::session>(hdl);
+    // a member changed how it looks, joiners need a new snapshot
+    void forget_snapshot(shard &sh, const game::player &p) {
+        game::room *room = sh.world.room_of(p);
+        if (room) room->snapshot = game::room_snapshot();
     }
 
-    void on_close(connection_hdl hdl) {
-        auto it = m_sessions.find(hdl);
-        if (it == m_sessions.end()) {
+    void send_history(shard &sh, const game::player &p) {
+        game::room *room = sh.world.room_of(p);
+        if (!room || !room->messages || room->messages->size() == 0) return;
+
+        send_to(sh, p, room->messages->frame());
+    }
+
+    // the owner and settings of the player's room, for the player alone
+    void send_room_info(shard &sh, const game::player &p, uint8_t event) {
+        game::room *room = sh.world.room_of(p);
+        if (!room) return;
+
+        uint8_t buffer[network::room_info_size];
+        send_to(sh, p, network::make_frame(buffer, encode_room_info(buffer, event, *room)));
+    }
+
+    void send_dispatch(shard &sh, uint8_t* buffer, size_t size, uint32_t room) {
+        // encode once, every member gets the same prepared frame
+        send_dispatch(sh, network::make_frame(buffer, size), room);
+    }
+
+    void send_dispatch(shard &sh, network::frame_ptr frame, uint32_t index,
+                       network::outbox::kind kind = network::outbox::reliable) {
+        send_dispatch(sh, frame, index, kind, [](const game::player &) { return true; });
+    }
+
+    // to the members wanted() picks
+    template <typename Wanted>
+    void send_dispatch(shard &sh, const network::frame_ptr &frame, uint32_t index, network::outbox::kind kind,
+                       Wanted &&wanted) {
+        if (index == game::room_registry::none) return;
+
+        auto started = std::chrono::steady_clock::now();
+
+        auto send = [this, &sh, &frame, kind](const std::shared_ptr<network::session> &s, uint16_t id) {
+            send_to(sh, s, id, frame, kind);
+        };
+        sh.world.fan_out(index, sh.relays, wanted, send);
+        relay(sh, frame, kind);
+
+        sh.sends_per_event.record(sh.world.rooms[index].members());
+        sh.fanout_us.record(std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - started).count());
+    }
+
+    // the connection a session is the base of
+    static server::connection_type &connection_of(network::session &s) {
+        return static_cast<server::connection_type &>(s);
+    }
+
+    // straight to the socket if it keeps up, otherwise through the session's outbox
+    void send_to(shard &sh, const std::shared_ptr<network::session> &s, uint16_t player, const network::frame_ptr &frame,
+                 network::outbox::kind kind = network::outbox::reliable) {
+        server::connection_type &con = connection_of(*s);
+
+        if (network::frame_ptr tracked = s->out.push(frame, kind)) {
+            con.send(tracked);
+        } else if (s->out.list()) {
+            sh.backlog.push_back({s, player});
+        }
+    }
+
+    void send_to(shard &sh, const game::player &p, const network::frame_ptr &frame,
+                 network::outbox::kind kind = network::outbox::reliable) {
+        if (p.gateway != game::player::local) {
+            sh.relays[p.gateway].push_back(p.id);
+            relay(sh, frame, kind);
             return;
         }
-        m_sessions.erase(it);
+
+        auto s = p.session.lock();
+        if (s) send_to(sh, s, p.id, frame, kind);
     }
 
+    // one message per gateway process for the players collected in sh.relays
+    void relay(shard &sh, const network::frame_ptr &frame, network::outbox::kind kind) {
+        for (uint8_t gateway = 0; gateway < sh.relays.size(); gateway++) {
+            std::vector<uint16_t> &ids = sh.relays[gateway];
+            if (ids.empty()) continue;
+
+            const std::string &payload = frame->get_payload();
+            std::vector<uint8_t> message = network::bus::message(network::bus_op::relay, 3 + ids.size() * 2 + payload.size());
+            network::bus::put_u8(message, kind);
+            network::bus::put_u16(message, static_cast<uint16_t>(ids.size()));
+            for (uint16_t id: ids) {
+                network::bus::put_u16(message, id);
+            }
+            network::bus::put_bytes(message, reinterpret_cast<const uint8_t *>(payload.data()), payload.size());
+            m_bus->send(gateway, std::move(message));
 
-    void on_message(connection_hdl hdl, message_ptr msg) {
-        if(msg->get_opcode() == websocketpp::frame::opcode::binary) {
-            std::string payload = msg->get_payload();
-            process_message(payload, hdl);
+            ids.clear();
         }
     }
 
-    void run(uint16_t port) {
-        m_server.listen(port);
-        m_server.start_accept();
-        m_server.run();
+    // send_to for the network thread, a session it can't write to yet joins the relay backlog
+    void relay_to(const std::shared_ptr<network::session> &s, const network::frame_ptr &frame, network::outbox::kind kind) {
+        server::connection_type &con = connection_of(*s);
+
+        if (network::frame_ptr tracked = s->out.push(frame, kind)) {
+            con.send(tracked);
+        } else if (s->out.list()) {
+            m_relay_backlog.push_back(s);
+        }
     }
 
-    void shutdown() {
-        m_server.stop_listening();
-        m_sessions.clear();
+    void schedule_relay_flush() {
+        m_relay_timer->expires_at(std::chrono::steady_clock::now() + m_tick_interval);
+        m_relay_timer->async_wait(m_network->wrap([this](websocketpp::lib::asio::error_code const & ec) {
+            if (ec) return;
+            flush_relay_backlog();
+            schedule_relay_flush();
+        }));
     }
 
-private:
-    server m_server;
+    // the player is hosted elsewhere, its owner sends the positions back through the bus
+    void flush_relay_backlog() {
+        auto now = std::chrono::steady_clock::now();
 
-    websocketpp::log::logger<websocketpp::log::alevel::log> alog;
-    websocketpp::log::logger<websocketpp::log::elevel::log> elog;
-    
-    game::game_manager game_world;
-
-    typedef struct {
-        std::size_t operator()(const websocketpp::connection_hdl& hdl) const {
-            return std::hash<std::uintptr_t>()(reinterpret_cast<std::uintptr_t>(hdl.lock().get()));
-        }
-    } connection_hdl_hash;
-
-    typedef struct {
-        bool operator()(const websocketpp::connection_hdl& lhs, const websocketpp::connection_hdl& rhs) const {
-            return !lhs.owner_before(rhs) && !rhs.owner_before(lhs);
-        }
-    } connection_hdl_equal;
-
-    std::unordered_map<connection_hdl, std::shared_ptr<network::session>, connection_hdl_hash, connection_hdl_equal> m_sessions;
-
-    void dispatch_entered_game(uint16_t id, std::string &room_id) {
-        uint8_t buffer[4];
-        buffer[0] = network::opcode::events;
-        buffer[1] = network::event::entered_game;
-        std::memcpy(&buffer[2], &id, 2);
-        send_dispatch(buffer, 4, room_id);
-    }
-
-    void dispatch_left_game(uint16_t id, std::string &room_id) {
-        uint8_t buffer[4];
-        buffer[0] = network::opcode::events;
-        buffer[1] = network::event::left_game;
-        std::memcpy(&buffer[2], &id, 2);
-        send_dispatch(buffer, 4, room_id);
-    }
-
-    void dispatch_message(const std::u16string &value, uint16_t id, std::u16string &nick, std::string &room_id) {
-        const int size = 1 + 1 + 2 + 2 * nick.length() + 2 + 2 * value.length() + 2;
-        std::vector<uint8_t> buffer(size);
-        buffer[0] = network::opcode::events;
-        int offset = 1;
-        buffer[offset++] = network::event::sent_message;
-        std::memcpy(&buffer[offset], &id, 2);
-        offset += 2;
-        std::memcpy(&buffer[offset], nick.data(), 2 * nick.length());
-        offset += 2 * nick.length();
-        buffer[offset++] = 0x00;
-        buffer[offset++] = 0x00;
-        std::memcpy(&buffer[offset], value.data(), 2 * value.length());
-        offset += 2 * value.length();
-        buffer[offset++] = 0x00;
-        buffer[offset++] = 0x00;
-
-        send_dispatch(buffer.data(), buffer.size(), room_id);
-    }
-
-    void dispatch_nick(uint16_t id, std::string &nick, std::string &room_id) {
-        uint8_t buffer[1+1+2+nick.length()+1];
-        buffer[0] = network::opcode::events;
-        buffer[1] = network::event::updated_nick;
-        std::memcpy(&buffer[2], &id, 2);
-        std::memcpy(&buffer[4], nick.data(), nick.length());
-        buffer[4+nick.length()] = 0x00;
-        send_dispatch(buffer, 1+1+2+nick.length()+1, room_id);
-    }
-
-    void dispatch_color(uint16_t id, uint8_t red, uint8_t green, uint8_t blue, std::string &room_id) {
-        uint8_t buffer[1+1+2+1+1+1];
-        buffer[0] = network::opcode::events;
-        buffer[1] = network::event::updated_color;
-        std::memcpy(&buffer[2], &id, 2);
-        buffer[4] = red;
-        buffer[5] = green;
-        buffer[6] = blue;
-
-        send_dispatch(buffer, 1+1+2+1+1+1, room_id);
-    }
-
-    void dispacth_entered_room(uint16_t id, std::string &room_id) {
-        uint8_t buffer[1+1+2];
-        buffer[0] = network::opcode::events;
-        buffer[1] = network::event::entered_room;
-        std::memcpy(&buffer[2], &id, 2);
-        send_dispatch(buffer, 1+1+2, room_id);
-    }
-
-    void dispacth_left_room(uint16_t id, std::string &room_id) {
-        uint8_t buffer[1+1+2];
-        buffer[0] = network::opcode::events;
-        buffer[1] = network::event::left_room;
-        std::memcpy(&buffer[2], &id, 2);
-        send_dispatch(buffer, 1+1+2, room_id);
-    }
-
-
-    void send_dispatch(uint8_t* buffer, size_t size, std::string &room_id) {
-        for (auto &pair: m_sessions) {
-            try {
-                if (
-                    m_server.get_con_from_hdl(pair.first)->get_state() == websocketpp::session::state::open
-                    && pair.second->did_enter_game()
-                    && pair.second->player->room_id == room_id
-                ) {
-                    m_server.send(pair.first, buffer, size, websocketpp::frame::opcode::binary);
+        for (size_t i = 0; i < m_relay_backlog.size();) {
+            network::session &s = *m_relay_backlog[i];
+            uint16_t id = s.player_id;
+
+            bool empty = flush_session(s, now, [this, id](server::connection_type &) {
+                request_positions(id);
+            });
+
+            if (empty) {
+                m_relay_backlog[i] = std::move(m_relay_backlog.back());
+                m_relay_backlog.pop_back();
+                continue;
+            }
+            i++;
+        }
+    }
+
+    // has whoever hosts the player send its client where everyone is, from any thread
+    void request_positions(uint16_t id) {
+        uint8_t owner = m_owners[id].load();
+        if (owner == m_process) {
+            post_to_player(id, [this](shard &sh, game::player &p) { send_positions(sh, p); });
+            return;
+        }
+
+        std::vector<uint8_t> message = network::bus::message(network::bus_op::resync, 2);
+        network::bus::put_u16(message, id);
+        m_bus->send(owner, std::move(message));
+    }
+
+    void flush_backlog(shard &sh) {
+        auto now = std::chrono::steady_clock::now();
+        std::unordered_map<uint32_t, network::frame_ptr> positions;
+        uint64_t queued = 0;
+
+        for (size_t i = 0; i < sh.backlog.size();) {
+            network::session &s = *sh.backlog[i].session;
+            uint16_t id = sh.backlog[i].player;
+
+            bool empty = flush_session(s, now, [this, &sh, &positions, &s, id](server::connection_type &con) {
+                game::player *p = sh.world.players.find(id);
+                if (!p) {
+                    // the session stays on the backlog of the shard that listed it,
+                    // the player may have moved to another shard or process since
+                    request_positions(id);
+                    return;
                 }
-            } catch (websocketpp::exception const & e) {
-                std::cout << "Send failed because: "
-                    << "(" << e.what() << ")" << std::endl;
+
+                game::room *room = sh.world.room_of(*p);
+                if (!room) return;
+
+                network::frame_ptr &frame = positions[p->room];
+                if (!frame) frame = encode_positions(room->cursors);
+                con.send(s.out.sending(frame));
+            });
+
+            if (empty) {
+                sh.backlog[i] = std::move(sh.backlog.back());
+                sh.backlog.pop_back();
+                continue;
             }
+
+            queued += s.out.size();
+            i++;
+        }
+
+        sh.backlog_sessions.set(sh.backlog.size());
+        sh.backlog_bytes.set(queued);
+    }
+
+    // writes what the session's socket takes now and closes it once it has been
+    // too slow for too long. resync(con) runs when cursor frames were dropped,
+    // to catch the client up with where everyone is. True once the outbox is
+    // empty and the session is off its backlog
+    template <typename Resync>
+    bool flush_session(network::session &s, std::chrono::steady_clock::time_point now, Resync &&resync) {
+        server::connection_type &con = connection_of(s);
+
+        bool done = con.get_state() != websocketpp::session::state::open;
+
+        if (!done && s.out.flush([&con](const network::frame_ptr &frame) { con.send(frame); })) {
+            resync(con);
+        }
+
+        if (!done && s.out.over_budget(now)) {
+            m_log.write<utils::log_level::info>(utils::log_event::too_slow, s.id);
+            websocketpp::lib::error_code ec;
+            con.close(websocketpp::close::status::try_again_later, "too slow", ec);
+            done = true;
         }
+
+        if (done) s.out.clear();
+
+        return s.out.unlist_if_empty();
     }
 };
 
 
-int main() {
-    mpp_server wsServer;
+static mpp_server *instance = nullptr;
+
+int main(int argc, char **argv) {
+    // ./server [tick rate in Hz] [shards] [chat log dir] [flood limits, e.g. chat=2/4,note=60/120]
+    //          [process, e.g. 0/4 for the first of four sharing the port] [bus dir] [I/O threads]
+    uint16_t tick_rate = argc > 1 ? std::atoi(argv[1]) : 30;
+    if (tick_rate == 0 || tick_rate > 1000) tick_rate = 30;
+
+    uint16_t shards = argc > 2 ? std::atoi(argv[2]) : std::thread::hardware_concurrency();
+    if (shards == 0) shards = 1;
+
+    std::string log_dir = argc > 3 ? argv[3] : "chatlog";
+
+    network::flood_limits flood_limits;
+    if (argc > 4 && !flood_limits.parse(argv[4])) {
+        std::cout << "bad flood limits \"" << argv[4] << "\", expected name=rate/burst,..." << std::endl;
+        return 1;
+    }
+
+    unsigned process = 0, process_count = 1;
+    if (argc > 5 && (std::sscanf(argv[5], "%u/%u", &process, &process_count) != 2
+                     || process_count == 0 || process_count > 64 || process >= process_count)) {
+        std::cout << "bad process \"" << argv[5] << "\", expected index/count, e.g. 0/4" << std::endl;
+        return 1;
+    }
+
+    std::string bus_dir = argc > 6 ? argv[6] : network::bus::default_dir();
+
+    uint16_t io_threads = argc > 7 ? std::atoi(argv[7]) : std::min(4u, std::thread::hardware_concurrency());
+    if (io_threads == 0) io_threads = 1;
+
+    mpp_server wsServer(tick_rate, shards, log_dir, flood_limits, process, process_count, bus_dir, io_threads);
+    instance = &wsServer;
 
     // this should fix the "Address already in use" exception
-    auto shutdown = [&wsServer](int signum) {
+    auto shutdown = [](int signum) {
         std::cout << "Signal " << signum << " received. Exiting cleanly." << std::endl;
-        wsServer.shutdown();
+        instance->shutdown();
         exit(signum);
-    }
+    };
 
     signal(SIGINT, shutdown);
     signal(SIGTERM, shutdown);
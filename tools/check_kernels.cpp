@@ -0,0 +1,140 @@
+// Kernel check: runs every vector kernel this machine has against the scalar
+// one of its family and fails on the first byte they disagree on. Covers
+// every tail length around the vector widths, edge values and random rows,
+// and guard bytes around the output to catch writes outside it.
+//
+// Build and run it, e.g.
+//   g++ -std=c++17 -O2 tools/check_kernels.cpp -o check_kernels && ./check_kernels
+// It exits non-zero on a mismatch. Kernels the CPU lacks are reported as skipped.
+
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "../game/normalize.hpp"
+#include "../network/pack.hpp"
+
+namespace {
+
+constexpr size_t max_rows = 80;     // past a few 16 row steps, so every tail length is seen
+constexpr size_t guard = 32;
+constexpr uint8_t guard_byte = 0xA5;
+
+const uint16_t edges[] = {0, 1, 0x7F, 0x80, 0xFF, 0x100, 0x7FFF, 0x8000, 0xFF00, 0xFFFE, 0xFFFF};
+const uint16_t screens[] = {0, 1, 2, 255, 1080, 1920, 32768, 65534, 65535};
+
+std::mt19937 rng(12345);
+
+uint16_t value(size_t i, int round) {
+    // the first rounds walk the edge values, the rest are random
+    if (round < 4) return edges[(i + round) % (sizeof(edges) / sizeof(edges[0]))];
+    return static_cast<uint16_t>(rng());
+}
+
+bool guards_intact(const std::vector<uint8_t> &buffer, size_t used) {
+    for (size_t i = 0; i < guard; i++) {
+        if (buffer[i] != guard_byte || buffer[guard + used + i] != guard_byte) return false;
+    }
+    return true;
+}
+
+// one kernel of cursor_packer over n rows, with guard bytes on both sides
+template <typename F>
+std::vector<uint8_t> pack_with(F &&kernel, size_t n) {
+    std::vector<uint8_t> buffer(guard + n * 7 + guard, guard_byte);
+    kernel(buffer.data() + guard);
+    return buffer;
+}
+
+bool check_pack(const char *name, size_t (*kernel)(size_t, uint8_t *, const uint16_t *, const uint16_t *,
+                                                   const uint16_t *, uint8_t)) {
+    const uint8_t flags[] = {0x00, 0x80, 0xC2, 0xFF};
+
+    for (int round = 0; round < 16; round++) {
+        for (size_t n = 0; n <= max_rows; n++) {
+            std::vector<uint16_t> id(n), x(n), y(n);
+            for (size_t i = 0; i < n; i++) {
+                id[i] = value(i, round);
+                x[i] = value(i + 3, round);
+                y[i] = value(i + 7, round);
+            }
+            uint8_t flag = flags[round % 4];
+
+            auto expected = pack_with([&](uint8_t *out) {
+                network::cursor_packer::scalar(0, n, out, id.data(), x.data(), y.data(), flag);
+            }, n);
+            auto actual = pack_with([&](uint8_t *out) {
+                size_t done = kernel(n, out, id.data(), x.data(), y.data(), flag);
+                network::cursor_packer::scalar(done, n, out, id.data(), x.data(), y.data(), flag);
+            }, n);
+
+            if (actual != expected || !guards_intact(actual, n * 7)) {
+                std::fprintf(stderr, "pack %s: mismatch with %zu rows in round %d\n", name, n, round);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool check_normalize(const char *name, size_t (*kernel)(size_t, const uint16_t *, const uint16_t *, const uint32_t *,
+                                                        const uint8_t *, uint16_t *)) {
+    for (int round = 0; round < 16; round++) {
+        for (size_t n = 0; n <= max_rows; n++) {
+            std::vector<uint16_t> raw(n), limit(n), old(n);
+            std::vector<uint32_t> scale(n);
+            std::vector<uint8_t> moved(n);
+            for (size_t i = 0; i < n; i++) {
+                raw[i] = value(i, round);
+                uint16_t extent = round < 8 ? screens[(i + round) % (sizeof(screens) / sizeof(screens[0]))]
+                                            : static_cast<uint16_t>(rng());
+                game::screen_scale screen(extent, extent);
+                limit[i] = screen.width;
+                scale[i] = screen.x;
+                // all moved, none moved, then mixed, so the blend sees both sides
+                moved[i] = round == 0 ? 1 : round == 1 ? 0 : rng() % 2;
+                old[i] = static_cast<uint16_t>(rng());
+            }
+
+            std::vector<uint16_t> expected = old, actual = old;
+            game::axis_normalizer::scalar(0, n, raw.data(), limit.data(), scale.data(), moved.data(), expected.data());
+            size_t done = kernel(n, raw.data(), limit.data(), scale.data(), moved.data(), actual.data());
+            game::axis_normalizer::scalar(done, n, raw.data(), limit.data(), scale.data(), moved.data(), actual.data());
+
+            if (actual != expected) {
+                std::fprintf(stderr, "normalize %s: mismatch with %zu rows in round %d\n", name, n, round);
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+}
+
+int main() {
+    bool ok = true;
+    int checked = 0;
+
+#ifdef MPP_X86_KERNELS
+    if (utils::cpu().sse41) {
+        ok &= check_pack("sse4.1", network::cursor_packer::sse41);
+        ok &= check_normalize("sse4.1", game::axis_normalizer::sse41);
+        checked++;
+    } else {
+        std::printf("sse4.1: not supported here, skipped\n");
+    }
+
+    if (utils::cpu().avx2) {
+        ok &= check_pack("avx2", network::cursor_packer::avx2);
+        ok &= check_normalize("avx2", game::axis_normalizer::avx2);
+        checked++;
+    } else {
+        std::printf("avx2: not supported here, skipped\n");
+    }
+#endif
+
+    std::printf("%d vector kernel set(s) checked against scalar: %s\n", checked, ok ? "ok" : "MISMATCH");
+    return ok ? 0 : 1;
+}
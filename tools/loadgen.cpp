@@ -0,0 +1,413 @@
+// Load generator: opens many client connections to a running server, plays
+// the full handshake and then sends input, notes and chat at fixed rates,
+// measuring how long it takes the server to fan them out to the room.
+//
+// ./loadgen --uri=ws://127.0.0.1:8081 --clients=2000 --rooms=50 --skew=1
+//           --input-hz=20 --note-hz=2 --chat-per-min=2 --bots=0.1
+//           --ramp=500 --duration=60
+//
+// Every client runs in this process, so a sender's timestamp can be looked up
+// when its update arrives at a peer: input carries a per-player sequence
+// number as x, on a 65535x65535 screen so the server's normalization leaves
+// it as is, and chat carries the send time in its text.
+//
+// Build it like the server, e.g.
+//   g++ -std=c++17 -O2 -pthread -I<websocketpp> -I<asio> tools/loadgen.cpp -o loadgen
+// and raise the open file limit (ulimit -n) above the client count first.
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#define ASIO_STANDALONE
+
+#include <websocketpp/config/asio_no_tls_client.hpp>
+#include <websocketpp/client.hpp>
+
+#include "../network/opcodes.hpp"
+#include "../network/reader.hpp"
+#include "../utils/metrics.hpp"
+
+typedef websocketpp::client<websocketpp::config::asio_client> client;
+typedef websocketpp::connection_hdl connection_hdl;
+typedef std::chrono::steady_clock steady_clock;
+
+struct options {
+    std::string uri = "ws://127.0.0.1:8081";
+    size_t clients = 1000;
+    size_t rooms = 10;
+    double skew = 1.0;          // room i gets weight 1 / (i + 1)^skew, 0 is uniform
+    double input_hz = 20;
+    double note_hz = 2;
+    double chat_per_min = 2;
+    double bots = 0;            // fraction of clients that say hello_bot
+    size_t ramp = 500;          // new connections per second
+    int duration = 30;          // seconds after the last client connected
+
+    bool parse(int argc, char **argv) {
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            size_t eq = arg.find('=');
+            if (arg.compare(0, 2, "--") != 0 || eq == std::string::npos) return false;
+
+            std::string name = arg.substr(2, eq - 2), value = arg.substr(eq + 1);
+            if (name == "uri") uri = value;
+            else if (name == "clients") clients = std::strtoul(value.c_str(), nullptr, 10);
+            else if (name == "rooms") rooms = std::strtoul(value.c_str(), nullptr, 10);
+            else if (name == "skew") skew = std::atof(value.c_str());
+            else if (name == "input-hz") input_hz = std::atof(value.c_str());
+            else if (name == "note-hz") note_hz = std::atof(value.c_str());
+            else if (name == "chat-per-min") chat_per_min = std::atof(value.c_str());
+            else if (name == "bots") bots = std::atof(value.c_str());
+            else if (name == "ramp") ramp = std::strtoul(value.c_str(), nullptr, 10);
+            else if (name == "duration") duration = std::atoi(value.c_str());
+            else return false;
+        }
+
+        return clients > 0 && rooms > 0 && ramp > 0;
+    }
+};
+
+struct sim_client {
+    connection_hdl hdl;
+    std::string room;
+    bool bot = false;
+    bool open = false;
+    bool in_game = false;
+    uint16_t id = 0;
+    uint16_t seq = 0;
+
+    steady_clock::time_point next_input, next_note, next_chat;
+
+    // last input sequence seen from each sender, to count the ones never seen
+    std::unordered_map<uint16_t, uint16_t> last_seq;
+};
+
+class load_generator {
+public:
+    explicit load_generator(const options &opts) : opts(opts), clients(opts.clients),
+        rng(12345), client_of(65536, no_client), sent_at(opts.clients * ring) {
+        m_client.init_asio();
+        m_client.clear_access_channels(websocketpp::log::alevel::all);
+        m_client.clear_error_channels(websocketpp::log::elevel::all);
+
+        std::vector<double> weights;
+        for (size_t i = 0; i < opts.rooms; i++) {
+            weights.push_back(1.0 / std::pow(i + 1, opts.skew));
+        }
+        std::discrete_distribution<size_t> pick_room(weights.begin(), weights.end());
+        std::bernoulli_distribution pick_bot(opts.bots);
+
+        for (auto &c: clients) {
+            c.room = "load-" + std::to_string(pick_room(rng));
+            c.bot = pick_bot(rng);
+        }
+    }
+
+    void run() {
+        timer.reset(new websocketpp::lib::asio::steady_timer(m_client.get_io_service()));
+        started = last_report = steady_clock::now();
+        schedule();
+        m_client.run();
+        report(true);
+    }
+
+private:
+    static constexpr size_t ring = 256;
+    static constexpr uint32_t no_client = static_cast<uint32_t>(-1);
+
+    options opts;
+    client m_client;
+    std::vector<sim_client> clients;
+    std::unique_ptr<websocketpp::lib::asio::steady_timer> timer;
+    std::mt19937 rng;
+
+    size_t connecting = 0;
+    steady_clock::time_point started, last_report, all_connected;
+
+    // per player id, the index of the client the server gave it to
+    std::vector<uint32_t> client_of;
+    // when client i's input with sequence seq % ring was sent, in us since start
+    std::vector<int64_t> sent_at;
+
+    // totals since the last report
+    uint64_t sent_packets = 0, received_frames = 0, received_bytes = 0;
+    // totals for the run
+    uint64_t opened = 0, failed = 0, closed = 0, inputs_seen = 0, inputs_missed = 0;
+    utils::histogram input_latency_us, chat_latency_us;
+
+    int64_t now_us() const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(steady_clock::now() - started).count();
+    }
+
+    void schedule() {
+        timer->expires_at(steady_clock::now() + std::chrono::milliseconds(10));
+        timer->async_wait([this](websocketpp::lib::asio::error_code const & ec) {
+            if (ec) return;
+            if (step()) schedule();
+        });
+    }
+
+    // one 10ms step: connect the next few clients, send what's due, report once a second
+    bool step() {
+        auto now = steady_clock::now();
+
+        size_t target = std::min(opts.clients, static_cast<size_t>(
+            std::chrono::duration<double>(now - started).count() * opts.ramp) + 1);
+        while (connecting < target) {
+            connect(connecting++);
+        }
+        if (connecting == opts.clients && all_connected == steady_clock::time_point()) all_connected = now;
+
+        for (auto &c: clients) {
+            if (!c.in_game) continue;
+
+            if (opts.input_hz > 0 && now >= c.next_input) {
+                send_input(c);
+                c.next_input += interval(opts.input_hz);
+            }
+            if (opts.note_hz > 0 && now >= c.next_note) {
+                send_note(c);
+                c.next_note += interval(opts.note_hz);
+            }
+            if (opts.chat_per_min > 0 && now >= c.next_chat) {
+                send_chat(c);
+                c.next_chat += interval(opts.chat_per_min / 60);
+            }
+        }
+
+        if (now - last_report >= std::chrono::seconds(1)) {
+            report(false);
+            last_report = now;
+        }
+
+        if (all_connected != steady_clock::time_point() && now - all_connected >= std::chrono::seconds(opts.duration)) {
+            m_client.stop();
+            return false;
+        }
+
+        return true;
+    }
+
+    static steady_clock::duration interval(double hz) {
+        return std::chrono::duration_cast<steady_clock::duration>(std::chrono::duration<double>(1 / hz));
+    }
+
+    steady_clock::duration random_phase(double hz) {
+        if (hz <= 0) return steady_clock::duration::zero();
+        std::uniform_real_distribution<double> phase(0, 1 / hz);
+        return std::chrono::duration_cast<steady_clock::duration>(std::chrono::duration<double>(phase(rng)));
+    }
+
+    void connect(size_t index) {
+        websocketpp::lib::error_code ec;
+        client::connection_ptr con = m_client.get_connection(opts.uri, ec);
+        if (ec) {
+            failed++;
+            return;
+        }
+
+        clients[index].hdl = con->get_handle();
+        con->set_open_handler([this, index](connection_hdl) { on_open(clients[index]); });
+        con->set_fail_handler([this](connection_hdl) { failed++; });
+        con->set_close_handler([this, index](connection_hdl) {
+            clients[index].open = clients[index].in_game = false;
+            closed++;
+        });
+        con->set_message_handler([this, index](connection_hdl, client::message_ptr msg) {
+            on_message(clients[index], msg->get_payload());
+        });
+
+        m_client.connect(con);
+    }
+
+    void send(sim_client &c, const std::vector<uint8_t> &data) {
+        websocketpp::lib::error_code ec;
+        m_client.send(c.hdl, data.data(), data.size(), websocketpp::frame::opcode::binary, ec);
+        if (!ec) sent_packets++;
+    }
+
+    void on_open(sim_client &c) {
+        c.open = true;
+        opened++;
+
+        send(c, {network::opcode::ping});
+
+        // the full range screen is the one the server scales by exactly 1, so
+        // the sequence number sent as x comes back unchanged
+        uint16_t width = 65535, height = 65535;
+        send(c, {c.bot ? network::opcode::hello_bot : network::opcode::hello,
+            uint8_t(width), uint8_t(width >> 8), uint8_t(height), uint8_t(height >> 8)});
+
+        // [op][r][g][b][nick\0][room\0]
+        std::string nick = c.bot ? "loadbot" : "loadgen";
+        std::vector<uint8_t> enter = {network::opcode::enter_game, uint8_t(rng()), uint8_t(rng()), uint8_t(rng())};
+        enter.insert(enter.end(), nick.begin(), nick.end());
+        enter.push_back(0);
+        enter.insert(enter.end(), c.room.begin(), c.room.end());
+        enter.push_back(0);
+        send(c, enter);
+    }
+
+    void send_input(sim_client &c) {
+        uint16_t x = ++c.seq, y = static_cast<uint16_t>(rng());
+        sent_at[index_of(c) * ring + x % ring] = now_us();
+        send(c, {network::opcode::input, uint8_t(x), uint8_t(x >> 8), uint8_t(y), uint8_t(y >> 8)});
+    }
+
+    void send_note(sim_client &c) {
+        uint8_t key = 21 + rng() % 88;
+        send(c, {network::opcode::note, key, network::note_flag::down, 100});
+    }
+
+    void send_chat(sim_client &c) {
+        std::string text = "lg " + std::to_string(now_us());
+        std::vector<uint8_t> chat = {network::opcode::chat};
+        chat.insert(chat.end(), text.begin(), text.end());
+        chat.push_back(0);
+        send(c, chat);
+    }
+
+    void on_message(sim_client &c, const std::string &payload) {
+        received_frames++;
+        received_bytes += payload.size();
+
+        network::packet_reader reader(payload);
+        uint8_t op;
+        if (!reader.read_u8(op)) return;
+
+        switch (op) {
+            case network::opcode::entered_game:
+            {
+                if (!reader.read_u16(c.id)) return;
+                c.in_game = true;
+                client_of[c.id] = index_of(c);
+
+                // spread the clients' sends over their intervals
+                auto now = steady_clock::now();
+                c.next_input = now + random_phase(opts.input_hz);
+                c.next_note = now + random_phase(opts.note_hz);
+                c.next_chat = now + random_phase(opts.chat_per_min / 60);
+                break;
+            }
+
+            case network::opcode::cursors_v2:
+                read_cursors(c, reader);
+                break;
+
+            case network::opcode::events:
+            {
+                uint8_t event;
+                uint16_t id;
+                std::string_view nick, text;
+                if (!reader.read_u8(event) || event != network::event::sent_message) return;
+                if (!reader.read_u16(id) || !reader.read_string(nick) || !reader.read_string(text)) return;
+
+                if (text.size() > 3 && text.compare(0, 3, "lg ") == 0) {
+                    int64_t sent = std::strtoll(std::string(text.substr(3)).c_str(), nullptr, 10);
+                    chat_latency_us.record(now_us() - sent);
+                }
+                break;
+            }
+        }
+    }
+
+    // [u16 count] then [u16 id][u16 x][u16 y][u8 flag], full records add [r][g][b][nick\0]
+    void read_cursors(sim_client &c, network::packet_reader &reader) {
+        uint16_t count;
+        if (!reader.read_u16(count)) return;
+
+        int64_t now = now_us();
+
+        for (uint16_t i = 0; i < count; i++) {
+            uint16_t id, x, y;
+            uint8_t flag;
+            if (!reader.read_u16(id) || !reader.read_u16(x) || !reader.read_u16(y) || !reader.read_u8(flag)) return;
+
+            if (flag == network::cursor_flag::full || flag == network::cursor_flag::full_bot
+                || flag == network::cursor_flag::full_dev) {
+                const uint8_t *color;
+                std::string_view nick;
+                if (!reader.read_bytes(3, color) || !reader.read_string(nick)) return;
+                c.last_seq[id] = x;
+                continue;
+            }
+
+            if (flag != network::cursor_flag::partial) {
+                c.last_seq.erase(id);
+                continue;
+            }
+
+            // a resync repeats positions that were already seen, those aren't new inputs
+            auto last = c.last_seq.find(id);
+            if (last != c.last_seq.end()) {
+                uint16_t gap = x - last->second;
+                if (gap == 0 || gap >= 0x8000) continue;
+                inputs_missed += gap - 1;
+            }
+            c.last_seq[id] = x;
+
+            inputs_seen++;
+            // someone else's client, its send time isn't known
+            if (client_of[id] == no_client) continue;
+            int64_t latency = now - sent_at[client_of[id] * ring + x % ring];
+            if (latency >= 0) input_latency_us.record(latency);
+        }
+    }
+
+    uint32_t index_of(const sim_client &c) const {
+        return static_cast<uint32_t>(&c - clients.data());
+    }
+
+    static uint64_t percentile(const utils::histogram &h, double p) {
+        std::vector<uint64_t> counts;
+        uint64_t sum = 0, total = 0;
+        h.read(counts, sum);
+
+        for (uint64_t n: counts) total += n;
+        if (total == 0) return 0;
+
+        uint64_t rank = static_cast<uint64_t>(std::ceil(p * total)), seen = 0;
+        for (size_t i = 0; i < counts.size(); i++) {
+            seen += counts[i];
+            if (seen >= rank) return utils::histogram::upper_bound(i);
+        }
+        return 0;
+    }
+
+    void report(bool final) {
+        size_t in_game = 0;
+        for (auto &c: clients) in_game += c.in_game;
+
+        std::printf("%s%zu/%zu in game, %llu open, %llu failed, %llu closed | sent %llu/s, received %llu frames/s %.1f MB/s"
+            " | input p50 %llu us p99 %llu us, chat p50 %llu us p99 %llu us, input updates missed %.2f%%\n",
+            final ? "final: " : "", in_game, opts.clients,
+            (unsigned long long)opened, (unsigned long long)failed, (unsigned long long)closed,
+            (unsigned long long)sent_packets, (unsigned long long)received_frames, received_bytes / 1e6,
+            (unsigned long long)percentile(input_latency_us, 0.5), (unsigned long long)percentile(input_latency_us, 0.99),
+            (unsigned long long)percentile(chat_latency_us, 0.5), (unsigned long long)percentile(chat_latency_us, 0.99),
+            inputs_seen + inputs_missed ? 100.0 * inputs_missed / (inputs_seen + inputs_missed) : 0.0);
+        std::fflush(stdout);
+
+        sent_packets = received_frames = received_bytes = 0;
+    }
+};
+
+int main(int argc, char **argv) {
+    options opts;
+    if (!opts.parse(argc, argv)) {
+        std::fprintf(stderr, "usage: %s [--uri=ws://host:port] [--clients=N] [--rooms=N] [--skew=S]"
+            " [--input-hz=F] [--note-hz=F] [--chat-per-min=F] [--bots=fraction] [--ramp=per second]"
+            " [--duration=seconds]\n", argv[0]);
+        return 1;
+    }
+
+    load_generator(opts).run();
+    return 0;
+}
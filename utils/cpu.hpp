@@ -0,0 +1,55 @@
+#ifndef CPU_HPP
+#define CPU_HPP
+
+#include <cstddef>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define MPP_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace utils {
+
+// Instruction sets the vector kernels may use on the machine we run on. The
+// kernels are compiled for them with target attributes, so one binary runs
+// everywhere and picks the widest it can; checked once, on first use.
+struct cpu_features {
+    bool sse41 = false;
+    bool avx2 = false;
+};
+
+inline const cpu_features &cpu() {
+    static const cpu_features features = [] {
+        cpu_features f;
+#ifdef MPP_X86_KERNELS
+        __builtin_cpu_init();
+        f.sse41 = __builtin_cpu_supports("sse4.1");
+        f.avx2 = __builtin_cpu_supports("avx2");
+#endif
+        return f;
+    }();
+    return features;
+}
+
+// Runs a family of kernels that all compute the same thing over n rows.
+// Kernels has static scalar(begin, n, args...), and where MPP_X86_KERNELS is
+// defined sse41(n, args...) and avx2(n, args...), which do whole vectors only
+// and return how many rows that was. The widest one the CPU has goes first and
+// scalar() finishes the tail, or does everything on other machines, so which
+// kernel ran never shows in the output.
+template <typename Kernels, typename... Args>
+inline void run_kernels(size_t n, Args... args) {
+    size_t done = 0;
+#ifdef MPP_X86_KERNELS
+    if (cpu().avx2) {
+        done = Kernels::avx2(n, args...);
+    } else if (cpu().sse41) {
+        done = Kernels::sse41(n, args...);
+    }
+#endif
+    Kernels::scalar(done, n, args...);
+}
+
+}
+
+#endif
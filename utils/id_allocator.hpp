@@ -0,0 +1,78 @@
+#ifndef ID_ALLOCATOR_HPP
+#define ID_ALLOCATOR_HPP
+
+#include <bitset>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace utils {
+
+// Hands out 16-bit ids in constant time. Free ids wait in a FIFO ring, so a
+// released id goes to the back and is only handed out again once every id
+// freed before it has been, and not before its quarantine has passed. That
+// keeps a client from mistaking a new player for the cursor it just deleted.
+// Id 0 is never handed out, it means "no player" on the wire.
+class id_allocator {
+public:
+    typedef std::chrono::steady_clock clock;
+
+    static constexpr size_t id_count = 65536;
+
+    // hands out first..last, a smaller range keeps processes that share the
+    // id space from ever handing out the same id
+    explicit id_allocator(clock::duration quarantine = std::chrono::seconds(5),
+                          uint16_t first = 1, uint16_t last = id_count - 1)
+        : quarantine(quarantine), capacity(last - first + 1), free_ids(capacity), head(0), count(capacity) {
+        for (size_t i = 0; i < capacity; i++) {
+            free_ids[i] = {static_cast<uint16_t>(first + i), clock::time_point::min()};
+        }
+    }
+
+    // false when every id is taken or still in quarantine
+    bool allocate(uint16_t &id, clock::time_point now = clock::now()) {
+        if (count == 0) return false;
+
+        entry &e = free_ids[head];
+        if (e.released != clock::time_point::min() && now - e.released < quarantine) return false;
+
+        id = e.id;
+        head = (head + 1) % capacity;
+        count--;
+        used.set(id);
+        return true;
+    }
+
+    void release(uint16_t id, clock::time_point now = clock::now()) {
+        if (id == 0 || !used.test(id)) return;
+
+        used.reset(id);
+        free_ids[(head + count) % capacity] = {id, now};
+        count++;
+    }
+
+    bool in_use(uint16_t id) const {
+        return used.test(id);
+    }
+
+    size_t size() const {
+        return capacity - count;
+    }
+
+private:
+    struct entry {
+        uint16_t id;
+        clock::time_point released;
+    };
+
+    clock::duration quarantine;
+    size_t capacity;
+    // ring of free ids, oldest release at head
+    std::vector<entry> free_ids;
+    size_t head, count;
+    std::bitset<id_count> used;
+};
+
+}
+
+#endif
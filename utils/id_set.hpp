@@ -0,0 +1,42 @@
+#ifndef ID_SET_HPP
+#define ID_SET_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+namespace utils {
+
+// A set of 16-bit ids for scratch work that is filled and emptied over and
+// over. Membership is a stamp per id compared with the set's generation, so
+// clear() is a counter bump instead of a walk over what was inserted.
+class id_set {
+public:
+    static constexpr size_t id_count = 65536;
+
+    id_set() : stamps(id_count, 0), generation(1) {}
+
+    void insert(uint16_t id) {
+        stamps[id] = generation;
+    }
+
+    bool contains(uint16_t id) const {
+        return stamps[id] == generation;
+    }
+
+    void clear() {
+        if (++generation == 0) {
+            // wrapped, old stamps could match again
+            std::fill(stamps.begin(), stamps.end(), 0);
+            generation = 1;
+        }
+    }
+
+private:
+    std::vector<uint32_t> stamps;
+    uint32_t generation;
+};
+
+}
+
+#endif
@@ -0,0 +1,187 @@
+#ifndef LOGGER_HPP
+#define LOGGER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <thread>
+
+// records below this level are compiled out, 0 keeps everything
+#ifndef MPP_LOG_LEVEL
+#define MPP_LOG_LEVEL 2
+#endif
+
+namespace utils {
+
+namespace log_level {
+
+constexpr uint8_t trace = 0;
+constexpr uint8_t debug = 1;
+constexpr uint8_t info = 2;
+constexpr uint8_t warn = 3;
+constexpr uint8_t error = 4;
+
+} // log_level
+
+// what happened, the reason code of a record
+namespace log_event {
+
+constexpr uint8_t ping = 0;
+constexpr uint8_t hello = 1;
+constexpr uint8_t resize = 2;
+constexpr uint8_t bad_length = 3;
+constexpr uint8_t not_allowed = 4;
+constexpr uint8_t bad_packet = 5;
+constexpr uint8_t bad_screen = 6;
+constexpr uint8_t empty_message = 7;
+constexpr uint8_t flood_drop = 8;
+constexpr uint8_t flood_mute = 9;
+constexpr uint8_t flood_kick = 10;
+constexpr uint8_t dev_kick = 11;
+constexpr uint8_t dev_mute = 12;
+constexpr uint8_t dev_ban = 13;
+constexpr uint8_t banned = 14;
+constexpr uint8_t out_of_ids = 15;
+constexpr uint8_t too_slow = 16;
+constexpr uint8_t handshake_timeout = 17;
+constexpr uint8_t ping_timeout = 18;
+constexpr uint8_t idle = 19;
+constexpr uint8_t count = 20;
+
+} // log_event
+
+struct log_record {
+    int64_t time_us;
+    uint32_t session;
+    uint32_t value;
+    uint8_t level;
+    uint8_t event;
+    uint8_t opcode;
+};
+
+// Fixed-size records go into a bounded ring that any thread can write without
+// locking; a background thread formats them. Writers never wait: when the
+// ring is full the record is dropped and counted.
+class logger {
+public:
+    static constexpr size_t capacity = 1 << 14;
+
+    logger() : slots(new slot[capacity]), head(0), tail(0), dropped(0), running(false) {
+        for (size_t i = 0; i < capacity; i++) {
+            slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    ~logger() {
+        stop();
+    }
+
+    void start(FILE *out = stdout) {
+        if (running.exchange(true)) return;
+
+        worker = std::thread([this, out]() {
+            while (running.load(std::memory_order_acquire)) {
+                if (!drain(out)) std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            drain(out);
+        });
+    }
+
+    void stop() {
+        if (!running.exchange(false)) return;
+        worker.join();
+    }
+
+    template <uint8_t level>
+    void write(uint8_t event, uint32_t session = 0, uint8_t opcode = 0, uint32_t value = 0) {
+        if constexpr (level >= MPP_LOG_LEVEL) {
+            push({now_us(), session, value, level, event, opcode});
+        }
+    }
+
+private:
+    struct slot {
+        std::atomic<size_t> sequence;
+        log_record record;
+    };
+
+    std::unique_ptr<slot[]> slots;
+    alignas(64) std::atomic<size_t> head;
+    alignas(64) size_t tail;
+    std::atomic<uint64_t> dropped;
+    std::atomic<bool> running;
+    std::thread worker;
+
+    static int64_t now_us() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+    }
+
+    // a slot is free for position pos when its sequence is pos, and holds a
+    // record for the reader when it is pos + 1
+    void push(const log_record &record) {
+        size_t pos = head.load(std::memory_order_relaxed);
+        slot *s;
+
+        for (;;) {
+            s = &slots[pos & (capacity - 1)];
+            size_t sequence = s->sequence.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+
+            if (diff == 0) {
+                if (head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+            } else if (diff < 0) {
+                dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } else {
+                pos = head.load(std::memory_order_relaxed);
+            }
+        }
+
+        s->record = record;
+        s->sequence.store(pos + 1, std::memory_order_release);
+    }
+
+    // only the worker reads
+    bool drain(FILE *out) {
+        bool any = false;
+
+        for (;;) {
+            slot &s = slots[tail & (capacity - 1)];
+            if (s.sequence.load(std::memory_order_acquire) != tail + 1) break;
+
+            print(out, s.record);
+            s.sequence.store(tail + capacity, std::memory_order_release);
+            tail++;
+            any = true;
+        }
+
+        uint64_t lost = dropped.exchange(0, std::memory_order_relaxed);
+        if (lost) std::fprintf(out, "log ring full, dropped %llu records\n", static_cast<unsigned long long>(lost));
+
+        if (any || lost) std::fflush(out);
+        return any;
+    }
+
+    static void print(FILE *out, const log_record &r) {
+        static const char *levels[] = {"trace", "debug", "info", "warn", "error"};
+        static const char *events[log_event::count] = {
+            "ping", "hello", "resize", "bad_length", "not_allowed", "bad_packet",
+            "bad_screen", "empty_message", "flood_drop", "flood_mute", "flood_kick",
+            "dev_kick", "dev_mute", "dev_ban", "banned", "out_of_ids", "too_slow",
+            "handshake_timeout", "ping_timeout", "idle"
+        };
+
+        std::fprintf(out, "%lld.%06lld %s %s session=%u opcode=0x%02x value=%u\n",
+            static_cast<long long>(r.time_us / 1000000), static_cast<long long>(r.time_us % 1000000),
+            r.level <= log_level::error ? levels[r.level] : "?",
+            r.event < log_event::count ? events[r.event] : "?",
+            r.session, r.opcode, r.value);
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,146 @@
+#ifndef METRICS_HPP
+#define METRICS_HPP
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace utils {
+
+// Every metric has exactly one writing thread, so updates are a plain load and
+// store, no locked instructions. Anyone may read them at any time.
+class counter {
+public:
+    void add(uint64_t n = 1) {
+        value.store(value.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    void set(uint64_t n) {
+        value.store(n, std::memory_order_relaxed);
+    }
+
+    uint64_t get() const {
+        return value.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<uint64_t> value{0};
+};
+
+// HDR-style log-linear histogram: every power of two is split into 16 equal
+// buckets, so any value is recorded within ~6% of itself, from 1 up to 2^32.
+class histogram {
+public:
+    static constexpr unsigned sub_bits = 4;
+    static constexpr unsigned sub_buckets = 1 << sub_bits;
+    static constexpr unsigned max_bits = 32;
+    static constexpr size_t bucket_count = (max_bits - sub_bits + 1) * sub_buckets;
+
+    void record(uint64_t value) {
+        buckets[index_of(value)].add();
+        sum.add(value);
+    }
+
+    static size_t index_of(uint64_t value) {
+        if (value >= (uint64_t(1) << max_bits)) value = (uint64_t(1) << max_bits) - 1;
+        if (value < sub_buckets) return value;
+
+        unsigned magnitude = 63 - __builtin_clzll(value);
+        unsigned shift = magnitude - sub_bits;
+        return (shift + 1) * sub_buckets + ((value >> shift) - sub_buckets);
+    }
+
+    // largest value that lands in bucket i
+    static uint64_t upper_bound(size_t i) {
+        if (i < sub_buckets) return i;
+
+        unsigned shift = i / sub_buckets - 1;
+        uint64_t top = i % sub_buckets + sub_buckets;
+        return ((top + 1) << shift) - 1;
+    }
+
+    // adds this histogram's buckets into counts, e.g. to merge the shards' ones
+    void read(std::vector<uint64_t> &counts, uint64_t &total) const {
+        counts.resize(bucket_count);
+        for (size_t i = 0; i < bucket_count; i++) {
+            counts[i] += buckets[i].get();
+        }
+        total += sum.get();
+    }
+
+private:
+    std::array<counter, bucket_count> buckets;
+    counter sum;
+};
+
+// Prometheus text exposition
+class exposition {
+public:
+    void type(const char *name, const char *kind) {
+        text += "# TYPE ";
+        text += name;
+        text += ' ';
+        text += kind;
+        text += '\n';
+    }
+
+    // labels are already formatted, e.g. opcode="0x07"
+    void sample(const char *name, const std::string &labels, uint64_t value) {
+        text += name;
+        if (!labels.empty()) {
+            text += '{';
+            text += labels;
+            text += '}';
+        }
+        text += ' ';
+        text += std::to_string(value);
+        text += '\n';
+    }
+
+    // buckets that add nothing over the previous one are left out, they
+    // would only repeat its cumulative count
+    void histogram_samples(const char *name, const std::vector<uint64_t> &counts, uint64_t sum) {
+        std::string bucket = std::string(name) + "_bucket";
+        uint64_t cumulative = 0;
+
+        for (size_t i = 0; i < counts.size(); i++) {
+            if (counts[i] == 0) continue;
+            cumulative += counts[i];
+            sample(bucket.c_str(), "le=\"" + std::to_string(histogram::upper_bound(i)) + "\"", cumulative);
+        }
+
+        sample(bucket.c_str(), "le=\"+Inf\"", cumulative);
+        sample((std::string(name) + "_sum").c_str(), "", sum);
+        sample((std::string(name) + "_count").c_str(), "", cumulative);
+    }
+
+    static std::string label(const char *name, const std::string &value) {
+        std::string out = name;
+        out += "=\"";
+        for (char c: value) {
+            if (c == '\\' || c == '"') out += '\\';
+            if (c == '\n') {
+                out += "\\n";
+                continue;
+            }
+            out += c;
+        }
+        out += '"';
+        return out;
+    }
+
+    static std::string hex_label(const char *name, uint8_t value) {
+        char buffer[8];
+        std::snprintf(buffer, sizeof(buffer), "0x%02x", value);
+        return std::string(name) + "=\"" + buffer + "\"";
+    }
+
+    std::string text;
+};
+
+}
+
+#endif
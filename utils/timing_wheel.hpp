@@ -0,0 +1,202 @@
+#ifndef TIMING_WHEEL_HPP
+#define TIMING_WHEEL_HPP
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+namespace utils {
+
+// Deadlines for many objects on one thread without a timer each. Four wheels
+// of 256 slots, each slot of a wheel spanning the whole wheel below it, so
+// with 250ms ticks they reach about a minute, 4.5 hours, 48 days and 34 years.
+// Scheduling and cancelling link or unlink one entry; advancing runs the due
+// slot of the first wheel, and every 256 ticks spreads one slot of the next
+// wheel over the ones below. Entries live in a pool and are named by index, so
+// whoever owns a deadline keeps a 4 byte handle. Not thread-safe, it belongs
+// to the thread that advances it.
+template <typename T>
+class timing_wheel {
+public:
+    typedef std::chrono::steady_clock clock;
+    typedef uint32_t handle;
+
+    static constexpr handle none = static_cast<handle>(-1);
+
+    explicit timing_wheel(clock::duration resolution, clock::time_point start = clock::now())
+        : resolution(resolution), start(start), current(start), next_tick(1), free_head(none), pending(0) {
+        heads.fill(none);
+    }
+
+    // hands value to advance() once delay has passed since now(), at most two
+    // ticks late. Delays past the last wheel are cut to its reach
+    handle schedule(const T &value, clock::duration delay) {
+        uint64_t ticks = delay <= clock::duration::zero() ? 0 : (delay + resolution - clock::duration(1)) / resolution;
+
+        handle h = acquire();
+        entry &e = entries[h];
+        e.value = value;
+        // from now(), which is ahead of next_tick while advance() catches up
+        e.expires = tick_of(current) + 1 + ticks;
+        link(h);
+
+        pending++;
+        return h;
+    }
+
+    // h is none afterwards, cancelling none does nothing
+    void cancel(handle &h) {
+        if (h == none) return;
+
+        unlink(h);
+        release(h);
+        pending--;
+        h = none;
+    }
+
+    // when advance() last ran, for callers that need the time but not to the microsecond
+    clock::time_point now() const {
+        return current;
+    }
+
+    size_t size() const {
+        return pending;
+    }
+
+    // runs expired(value) for every entry due by now. The entry's handle is
+    // already free when it runs, so it may schedule again
+    template <typename F>
+    void advance(clock::time_point now, F &&expired) {
+        current = now;
+
+        uint64_t target = tick_of(now);
+        while (next_tick <= target) {
+            size_t index = next_tick & mask;
+            if (index == 0) cascade();
+
+            // moved aside first, so what runs can't add to the slot being run
+            splice(index);
+            next_tick++;
+
+            while (heads[due] != none) {
+                handle h = heads[due];
+                unlink(h);
+                T value = entries[h].value;
+                release(h);
+                pending--;
+                expired(value);
+            }
+        }
+    }
+
+private:
+    static constexpr unsigned bits = 8;
+    static constexpr unsigned levels = 4;
+    static constexpr size_t slots = size_t(1) << bits;
+    static constexpr size_t mask = slots - 1;
+    static constexpr uint64_t horizon = (uint64_t(1) << (bits * levels)) - 1;
+    // where a slot's entries wait while they run or are handed down
+    static constexpr size_t due = levels * slots;
+
+    struct entry {
+        T value;
+        uint64_t expires;
+        handle prev, next;
+        uint32_t slot;
+    };
+
+    clock::duration resolution;
+    clock::time_point start, current;
+    // the first tick advance() hasn't run yet
+    uint64_t next_tick;
+    std::array<handle, levels * slots + 1> heads;
+    std::vector<entry> entries;
+    handle free_head;
+    size_t pending;
+
+    uint64_t tick_of(clock::time_point t) const {
+        return t < start ? 0 : (t - start) / resolution;
+    }
+
+    handle acquire() {
+        if (free_head == none) {
+            entries.emplace_back();
+            return static_cast<handle>(entries.size() - 1);
+        }
+
+        handle h = free_head;
+        free_head = entries[h].next;
+        return h;
+    }
+
+    void release(handle h) {
+        entries[h].value = T();
+        entries[h].next = free_head;
+        free_head = h;
+    }
+
+    // into the lowest wheel whose span covers the time left
+    void link(handle h) {
+        entry &e = entries[h];
+        if (e.expires - next_tick > horizon) e.expires = next_tick + horizon;
+
+        uint64_t delta = e.expires - next_tick;
+        unsigned level = 0;
+        while (level + 1 < levels && delta >= (uint64_t(1) << (bits * (level + 1)))) {
+            level++;
+        }
+
+        push(h, level * slots + ((e.expires >> (bits * level)) & mask));
+    }
+
+    void push(handle h, size_t slot) {
+        entry &e = entries[h];
+        e.slot = static_cast<uint32_t>(slot);
+        e.prev = none;
+        e.next = heads[slot];
+        if (e.next != none) entries[e.next].prev = h;
+        heads[slot] = h;
+    }
+
+    void unlink(handle h) {
+        entry &e = entries[h];
+        if (e.prev != none) {
+            entries[e.prev].next = e.next;
+        } else {
+            heads[e.slot] = e.next;
+        }
+        if (e.next != none) entries[e.next].prev = e.prev;
+    }
+
+    // moves a slot's entries to the due list
+    void splice(size_t slot) {
+        while (heads[slot] != none) {
+            handle h = heads[slot];
+            unlink(h);
+            push(h, due);
+        }
+    }
+
+    // the first wheel wrapped: every wheel that wrapped with it hands its
+    // current slot down, the highest first so nothing is handed down twice
+    void cascade() {
+        unsigned top = 1;
+        while (top + 1 < levels && ((next_tick >> (bits * top)) & mask) == 0) {
+            top++;
+        }
+
+        for (unsigned level = top; level >= 1; level--) {
+            splice(level * slots + ((next_tick >> (bits * level)) & mask));
+            while (heads[due] != none) {
+                handle h = heads[due];
+                unlink(h);
+                link(h);
+            }
+        }
+    }
+};
+
+}
+
+#endif